@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+/** Contiguous buffer of unboxed values. Slices share the buffer, so slicing
+ *  does not copy. **/
+template < typename T >
+struct packed_array
+{
+    using buffer_t = std::vector< T >;
+
+    std::shared_ptr< buffer_t > buffer;
+    size_t offset = 0;
+    size_t length = 0;
+
+    packed_array() : buffer( std::make_shared< buffer_t >() ) {}
+
+    explicit packed_array( buffer_t values )
+        : buffer( std::make_shared< buffer_t >( std::move( values ) ) )
+        , offset( 0 )
+        , length( buffer->size() ) {}
+
+    const T* data() const { return buffer->data() + offset; }
+
+    /** No other array shares the buffer, it may be written in place. **/
+    bool unique() const { return buffer.use_count() == 1; }
+
+    T* mutable_data() { return buffer->data() + offset; }
+
+    size_t size() const { return length; }
+
+    T operator[]( size_t i ) const { return data()[ i ]; }
+
+    /** Elements in [ from, to ), the bounds are checked by the caller. **/
+    packed_array slice( size_t from, size_t to ) const
+    {
+        packed_array result = *this;
+        result.offset = offset + from;
+        result.length = to - from;
+        return result;
+    }
+
+    bool operator ==( const packed_array &o ) const
+    {
+        if ( length != o.length )
+            return false;
+        for ( size_t i = 0; i < length; i++ )
+            if ( ( *this )[ i ] != o[ i ] )
+                return false;
+        return true;
+    }
+
+    std::size_t hash() const
+    {
+        std::size_t h = length;
+        for ( size_t i = 0; i < length; i++ )
+            h = h * 31 + std::hash< T >()( ( *this )[ i ] );
+        return h;
+    }
+
+    friend std::ostream& operator <<( std::ostream& os, const packed_array& a )
+    {
+        const size_t shown = 16;
+        os << "Array [";
+        for ( size_t i = 0; i < a.size() && i < shown; i++ )
+            os << " " << a[ i ];
+        if ( a.size() > shown )
+            os << " ... (" << a.size() << ")";
+        return os << " ]";
+    }
+};
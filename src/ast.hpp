@@ -2,8 +2,10 @@
 
 #include <variant>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "bigint.hpp"
 #include "pattern.hpp"
 #include "pprint.hpp"
 #include "types.hpp"
@@ -16,23 +18,50 @@ namespace ast {
     struct function_call;
     struct function_def;
     struct let_in;
+    struct if_then_else;
+    struct record_def;
+    struct type_def;
+    struct field_access;
 
     using ast_node = std::variant< variable
                                  , function_call
                                  , function_def
-                                 , literal< int >
+                                 , literal< int_t >
+                                 , literal< bigint >
+                                 , literal< double >
+                                 , literal< std::string >
                                  , literal< bool >
-                                 , let_in >;
+                                 , let_in
+                                 , if_then_else
+                                 , record_def
+                                 , type_def
+                                 , field_access >;
 
     using node_ptr = std::shared_ptr< ast_node >;
 
+    /** Non-owning reference to a node, the tree is kept alive by its root.
+     *  Unlike copies of a node_ptr, copies of it do not update a reference
+     *  count shared by all threads evaluating the tree. **/
+    struct node_ref
+    {
+        const ast_node* node = nullptr;
+
+        node_ref() = default;
+        node_ref( const node_ptr& n ) : node( n.get() ) {}
+
+        const ast_node& operator *() const { return *node; }
+        const ast_node* operator ->() const { return node; }
+        const ast_node* get() const { return node; }
+    };
+
     template< typename value_t >
     struct literal_pattern;
     struct variable_pattern;
     struct object_pattern;
     struct function_path;
 
-    using pattern = std::variant< ast::literal_pattern< int >
+    using pattern = std::variant< ast::literal_pattern< int_t >
+                                , ast::literal_pattern< double >
                                 , ast::literal_pattern< bool >
                                 , ast::variable_pattern
                                 , ast::object_pattern >;
@@ -50,6 +79,8 @@ namespace ast {
     struct variable
     {
         identifier_t name;
+        // no other use of the bound value follows, see ast_last_uses
+        bool last_use = false;
         variable ( identifier_t name ) : name( name ) {};
     };
 
@@ -80,6 +111,7 @@ namespace ast {
     {
         identifier_t name;
         std::vector< pattern > patterns;
+        type_tag tag = {};
     };
 
     struct function_path
@@ -93,13 +125,63 @@ namespace ast {
     {
         std::vector< path_ptr > paths;
         int arity;
+        // stable identifier of the definition in the source, -1 if none
+        int id = -1;
     };
 
+    /** A let, record or type without expression is a definition of the
+     *  top level, see parser::p_item. **/
     struct let_in
     {
         pattern pat;
         node_ptr value;
         node_ptr expression;
+        // the pattern (a single variable) is bound in the value as well
+        bool recursive = false;
+        // the value is evaluated on the first use of the variable
+        bool lazy = false;
+    };
+
+    struct if_then_else
+    {
+        node_ptr condition;
+        node_ptr then_branch;
+        node_ptr else_branch;
+    };
+
+    /** record name := fields in expression, the name is bound to the
+     *  constructor in the expression. **/
+    struct record_def
+    {
+        identifier_t name;
+        std::vector< identifier_t > fields;
+        node_ptr expression;
+        type_tag tag = {};
+    };
+
+    struct constructor_def
+    {
+        identifier_t name;
+        std::vector< identifier_t > fields;
+        type_tag tag;
+    };
+
+    /** type name := constructors in expression, the constructors are bound
+     *  in the expression. **/
+    struct type_def
+    {
+        identifier_t name;
+        std::vector< constructor_def > constructors;
+        node_ptr expression;
+    };
+
+    /** record.field, the offsets of the field in the records declaring it
+     *  are resolved by the parser, the record of the object picks one. **/
+    struct field_access
+    {
+        node_ptr record;
+        identifier_t field;
+        std::vector< std::pair< identifier_t, int > > offsets;
     };
 
     ///////////////////////////////////////////////////////////////////////////
@@ -182,7 +264,9 @@ namespace ast {
         static void _variables_in( const variable_pattern& pattern
                                  , id_set_t& variables )
         {
-            variables.insert( pattern.name );
+            // the wildcard does not bind
+            if ( pattern.name != "_" )
+                variables.insert( pattern.name );
         }
 
         static void _variables_in( const object_pattern& object
@@ -216,18 +300,176 @@ namespace ast {
                                    , id_set_t& vars
                                    , blacklist_t& blacklist )
         {
-            _free_variables( *letin.value, vars, blacklist );
             id_set_t bound = variables_in( letin.pat );
+            if ( ! letin.recursive )
+                _free_variables( *letin.value, vars, blacklist );
             blacklist.layers.push_back( std::move( bound ) );
+            if ( letin.recursive )
+                _free_variables( *letin.value, vars, blacklist );
             _free_variables( *letin.expression, vars, blacklist );
             blacklist.layers.pop_back();
         }
 
+        static void _free_variables( const if_then_else& ite
+                                   , id_set_t& vars
+                                   , blacklist_t& blacklist )
+        {
+            _free_variables( *ite.condition, vars, blacklist );
+            _free_variables( *ite.then_branch, vars, blacklist );
+            _free_variables( *ite.else_branch, vars, blacklist );
+        }
+
+        static void _free_variables( const record_def& record
+                                   , id_set_t& vars
+                                   , blacklist_t& blacklist )
+        {
+            blacklist.layers.push_back( { record.name } );
+            _free_variables( *record.expression, vars, blacklist );
+            blacklist.layers.pop_back();
+        }
+
+        static void _free_variables( const type_def& type
+                                   , id_set_t& vars
+                                   , blacklist_t& blacklist )
+        {
+            id_set_t names;
+            for ( const auto& c : type.constructors )
+                names.insert( c.name );
+            blacklist.layers.push_back( std::move( names ) );
+            _free_variables( *type.expression, vars, blacklist );
+            blacklist.layers.pop_back();
+        }
+
+        static void _free_variables( const field_access& access
+                                   , id_set_t& vars
+                                   , blacklist_t& blacklist )
+        {
+            _free_variables( *access.record, vars, blacklist );
+        }
+
 
     };
 
 
 
+    ///////////////////////////////////////////////////////////////////////////
+    // Last uses
+    ///////////////////////////////////////////////////////////////////////////
+
+    /** Marks the only occurrence of a bound variable in the scope of its
+     *  binding as the last use, the evaluator may then move the value out of
+     *  the store instead of copying it. Occurrences in nested functions and
+     *  lazy values do not qualify, those may be evaluated repeatedly. **/
+    struct ast_last_uses
+    {
+        using id_set_t = ast_free_vars::id_set_t;
+
+        struct use_t
+        {
+            int count = 0;
+            variable* occurrence = nullptr;
+        };
+
+        using uses_t = std::map< identifier_t, use_t >;
+
+        static void mark( const id_set_t& bound, const std::vector< ast_node* >& scope )
+        {
+            uses_t uses;
+            for ( const auto& name : bound )
+                uses[ name ] = {};
+            for ( auto* node : scope )
+                _count( *node, uses, {}, false );
+            for ( auto& [ name, use ] : uses )
+                if ( use.count == 1 && use.occurrence != nullptr )
+                    use.occurrence->last_use = true;
+        }
+
+        static void _count( ast_node& node, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            std::visit( [&]( auto& v ){ _count( v, uses, shadowed, nested ); }, node );
+        }
+
+        template < typename value_t >
+        static void _count( literal< value_t >& l, uses_t& uses
+                          , const id_set_t& shadowed, bool nested ) {}
+
+        static void _count( variable& v, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            auto it = uses.find( v.name );
+            if ( it == uses.end() || shadowed.count( v.name ) )
+                return;
+            it->second.count += nested ? 2 : 1;
+            it->second.occurrence = &v;
+        }
+
+        static void _count( function_call& call, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            _count( *call.fun, uses, shadowed, nested );
+            for ( auto& a : call.args )
+                _count( *a, uses, shadowed, nested );
+        }
+
+        static id_set_t shadow( const id_set_t& shadowed, const pattern& p )
+        {
+            id_set_t result = shadowed;
+            ast_free_vars::_variables_in( p, result );
+            return result;
+        }
+
+        static void _count( function_def& def, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            for ( const auto& path : def.paths ) {
+                id_set_t inner = shadowed;
+                for ( const auto& p : path->input_patterns )
+                    ast_free_vars::_variables_in( p, inner );
+                _count( *path->expression, uses, inner, true );
+            }
+        }
+
+        static void _count( let_in& l, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            id_set_t inner = shadow( shadowed, l.pat );
+            _count( *l.value, uses, l.recursive ? inner : shadowed, nested || l.lazy );
+            _count( *l.expression, uses, inner, nested );
+        }
+
+        static void _count( if_then_else& i, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            _count( *i.condition, uses, shadowed, nested );
+            _count( *i.then_branch, uses, shadowed, nested );
+            _count( *i.else_branch, uses, shadowed, nested );
+        }
+
+        static void _count( record_def& r, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            id_set_t inner = shadowed;
+            inner.insert( r.name );
+            _count( *r.expression, uses, inner, nested );
+        }
+
+        static void _count( type_def& t, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            id_set_t inner = shadowed;
+            for ( const auto& c : t.constructors )
+                inner.insert( c.name );
+            _count( *t.expression, uses, inner, nested );
+        }
+
+        static void _count( field_access& f, uses_t& uses
+                          , const id_set_t& shadowed, bool nested )
+        {
+            _count( *f.record, uses, shadowed, nested );
+        }
+    };
+
     ///////////////////////////////////////////////////////////////////////////////
     // Print visitor
     ///////////////////////////////////////////////////////////////////////////////
@@ -323,13 +565,51 @@ namespace ast {
 
         void accept( const let_in& l )
         {
-            printer.print( "LetIn" );
+            printer.print( l.recursive ? "LetRecIn" : l.lazy ? "LetLazyIn" : "LetIn" );
             indent();
             accept( l.pat );
             accept( *l.value );
             accept( *l.expression );
             dedent();
         }
+
+        void accept( const if_then_else& i )
+        {
+            printer.print( "IfThenElse" );
+            indent();
+            accept( *i.condition );
+            accept( *i.then_branch );
+            accept( *i.else_branch );
+            dedent();
+        }
+
+        void accept( const record_def& r )
+        {
+            printer.print( "Record", r.name );
+            indent();
+            for ( const auto& f : r.fields )
+                printer.print( "Field", f );
+            accept( *r.expression );
+            dedent();
+        }
+
+        void accept( const type_def& t )
+        {
+            printer.print( "Type", t.name );
+            indent();
+            for ( const auto& c : t.constructors )
+                printer.print( "Constructor", c.name, c.tag.tag, c.fields );
+            accept( *t.expression );
+            dedent();
+        }
+
+        void accept( const field_access& f )
+        {
+            printer.print( "FieldAccess", f.field, f.offsets );
+            indent();
+            accept( *f.record );
+            dedent();
+        }
     };
 
     node_ptr clone( const ast_node& a );
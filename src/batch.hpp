@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "parser.hpp"
+#include "eval.hpp"
+#include "builtins.hpp"
+#include "pool.hpp"
+
+template < typename parser_t >
+void add_operators( parser_t& p )
+{
+    p.op_table.insert( { "+",   { 6,    false } } );
+    p.op_table.insert( { "-",   { 6,    false } } );
+    p.op_table.insert( { "*",   { 7,    false } } );
+    p.op_table.insert( { "/",   { 7,    false } } );
+    p.op_table.insert( { "%",   { 7,    false } } );
+    p.op_table.insert( { "++",  { 5,    false } } );
+    p.op_table.insert( { "&&",  { 2,    false } } );
+    p.op_table.insert( { "||",  { 1,    false } } );
+}
+
+/** Many script files evaluated in one process. The files are parsed and
+ *  evaluated concurrently on a task pool, every one by its own evaluator of
+ *  a program image with the builtins, which is made once. The records are
+ *  written in the order of the files. **/
+struct batch
+{
+    struct job_t
+    {
+        std::string path;
+        std::atomic< bool > done{ false };
+        bool ok = false;
+        // the value or the error message
+        std::string result;
+    };
+
+    std::vector< std::unique_ptr< job_t > > jobs;
+
+    /** The files and the .sq files in the directories, in the order of
+     *  their names. **/
+    explicit batch( const std::vector< std::string >& paths )
+    {
+        namespace fs = std::filesystem;
+        for ( const auto& path : paths ) {
+            if ( fs::is_directory( path ) ) {
+                std::vector< std::string > files;
+                for ( const auto& entry : fs::directory_iterator( path ) )
+                    if ( entry.is_regular_file() && entry.path().extension() == ".sq" )
+                        files.push_back( entry.path().string() );
+                std::sort( files.begin(), files.end() );
+                for ( auto& f : files )
+                    add( std::move( f ) );
+            } else {
+                add( path );
+            }
+        }
+    }
+
+    /** Runs the jobs on the threads, writes a record per job: its path, ok
+     *  or error and the value of its last expression or the message,
+     *  separated by tabs. The fields are escaped, see escape. **/
+    void run( int threads, std::ostream& out )
+    {
+        auto program = std::make_shared< eval::program_t >();
+        builtins< eval >::add_builtins( *program );
+
+        task_pool pool( threads );
+        for ( auto& job : jobs )
+            pool.submit( [ program, job = job.get() ]{ evaluate( program, *job ); } );
+
+        for ( auto& job : jobs ) {
+            pool.help_until( [ & ]{ return job->done.load( std::memory_order_acquire ); } );
+            out << escape( job->path ) << '\t' << ( job->ok ? "ok" : "error" ) << '\t' << job->result << '\n';
+        }
+        out.flush();
+    }
+
+    static void evaluate( const std::shared_ptr< const eval::program_t >& program, job_t& job )
+    {
+        try {
+            std::ifstream file( job.path );
+            if ( ! file )
+                throw std::runtime_error( "cannot open " + job.path );
+            parser< istream_generator< std::ifstream > > p( { std::move( file ) }, 10 );
+            add_operators( p );
+
+            eval e( program );
+            while ( auto item = p.p_item() ) {
+                e.push( item );
+                e.run();
+            }
+            job.result = e.state._values.empty() ? "" : e.state.pop_value().to_string();
+            job.ok = true;
+        } catch ( parsing_error& err ) {
+            job.result = err.what();
+        } catch ( std::exception& err ) {
+            job.result = err.what();
+        } catch ( ... ) {
+            job.result = "unknown error";
+        }
+        job.result = escape( job.result );
+        job.done.store( true, std::memory_order_release );
+    }
+
+    /** A field of a record, on a single line and without tabs. Backslashes,
+     *  tabs, carriage returns and newlines are written as \\, \t, \r and \n. **/
+    static std::string escape( const std::string& field )
+    {
+        std::string escaped;
+        escaped.reserve( field.size() );
+        for ( char c : field ) {
+            if ( c == '\\' )
+                escaped += "\\\\";
+            else if ( c == '\t' )
+                escaped += "\\t";
+            else if ( c == '\n' )
+                escaped += "\\n";
+            else if ( c == '\r' )
+                escaped += "\\r";
+            else
+                escaped += c;
+        }
+        return escaped;
+    }
+
+private:
+    void add( std::string path )
+    {
+        jobs.push_back( std::make_unique< job_t >() );
+        jobs.back()->path = std::move( path );
+    }
+};
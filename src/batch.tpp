@@ -0,0 +1,63 @@
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "batch.hpp"
+
+namespace fs = std::filesystem;
+
+fs::path write_scripts()
+{
+    fs::path dir = fs::temp_directory_path() / "squid_batch_test";
+    fs::remove_all( dir );
+    fs::create_directory( dir );
+    for ( int i = 0; i < 20; i++ )
+        std::ofstream( dir / ( "job" + std::string( i < 10 ? "0" : "" ) + std::to_string( i ) + ".sq" ) )
+            << "let rec fib := fun |- 0 -> 0 |- 1 -> 1 |- n -> fib ( n - 1 ) + fib ( n - 2 ) in fib " << i;
+    std::ofstream( dir / "type_error.sq" ) << "1 + true";
+    std::ofstream( dir / "zz_items.sq" ) << "let k := 5 ; k * 2 ; k + 1";
+    std::ofstream( dir / "zz_text.sq" ) << "\"a\\tb\\nc\\\\d\"";
+    std::ofstream( dir / "syntax_error.sq" ) << "let x := in";
+    std::ofstream( dir / "notes.txt" ) << "not a script";
+    return dir;
+}
+
+void test_batch()
+{
+    fs::path dir = write_scripts();
+    std::string missing = ( dir / "missing.sq" ).string();
+
+    std::string expected;
+    for ( int threads : { 1, 4 } ) {
+        batch b( { dir.string(), missing } );
+        assert( b.jobs.size() == 25 );
+
+        std::stringstream out;
+        b.run( threads, out );
+
+        std::vector< std::string > lines;
+        for ( std::string line; std::getline( out, line ); )
+            lines.push_back( line );
+        assert( lines.size() == 25 );
+        assert( lines[ 0 ] == ( dir / "job00.sq" ).string() + "\tok\t( Int 0 )" );
+        assert( lines[ 19 ] == ( dir / "job19.sq" ).string() + "\tok\t( Int 4181 )" );
+        assert( lines[ 20 ].find( "syntax_error.sq\terror\t" ) != std::string::npos );
+        assert( lines[ 21 ].find( "type_error.sq\terror\texpected Int or Float" ) != std::string::npos );
+        assert( lines[ 22 ] == ( dir / "zz_items.sq" ).string() + "\tok\t( Int 6 )" );
+        // a record stays on a line of three fields
+        assert( lines[ 23 ] == ( dir / "zz_text.sq" ).string() + "\tok\t( String \"a\\tb\\nc\\\\d\" )" );
+        assert( lines[ 24 ] == missing + "\terror\tcannot open " + missing );
+
+        // the records do not depend on the number of threads
+        if ( expected.empty() )
+            expected = out.str();
+        assert( out.str() == expected );
+    }
+    fs::remove_all( dir );
+}
+
+int main()
+{
+    test_batch();
+}
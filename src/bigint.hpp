@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/** Arbitrary-precision integer, sign and magnitude in base 2^32 with the
+ *  least significant limb first and no leading zero limbs. Division rounds
+ *  towards zero like the builtin integers. **/
+struct bigint
+{
+    using limb_t = std::uint32_t;
+    using wide_t = std::uint64_t;
+    using limbs_t = std::vector< limb_t >;
+
+    /** Operands with fewer limbs are multiplied by the schoolbook method. **/
+    static constexpr std::size_t karatsuba_threshold = 32;
+
+    bool negative = false;
+    limbs_t limbs;
+
+    bigint() = default;
+
+    bigint( std::int64_t v )
+    {
+        negative = v < 0;
+        // negating in unsigned arithmetic is defined for the minimum too
+        wide_t m = negative ? wide_t( 0 ) - wide_t( v ) : wide_t( v );
+        for ( ; m != 0; m >>= 32 )
+            limbs.push_back( limb_t( m ) );
+    }
+
+    /** Decimal digits with an optional leading '-'. **/
+    static bigint from_string( const std::string& s )
+    {
+        bigint result;
+        std::size_t i = ( ! s.empty() && s[ 0 ] == '-' ) ? 1 : 0;
+        if ( i == s.size() )
+            throw std::invalid_argument( "not a number: " + s );
+        for ( ; i < s.size(); i++ ) {
+            if ( s[ i ] < '0' || s[ i ] > '9' )
+                throw std::invalid_argument( "not a number: " + s );
+            mul_add_small( result.limbs, 10, s[ i ] - '0' );
+        }
+        result.negative = s[ 0 ] == '-' && ! result.limbs.empty();
+        return result;
+    }
+
+    bool is_zero() const { return limbs.empty(); }
+
+    bool fits_int64() const
+    {
+        if ( limbs.size() > 2 )
+            return false;
+        wide_t m = magnitude64();
+        wide_t limit = wide_t( std::numeric_limits< std::int64_t >::max() );
+        return negative ? m <= limit + 1 : m <= limit;
+    }
+
+    /** Requires fits_int64(). **/
+    std::int64_t to_int64() const
+    {
+        wide_t m = magnitude64();
+        return negative ? std::int64_t( wide_t( 0 ) - m ) : std::int64_t( m );
+    }
+
+    /** Close to the nearest double, an infinity if out of range. **/
+    double to_double() const
+    {
+        double d = 0;
+        for ( std::size_t i = limbs.size(); i-- > 0; )
+            d = d * 4294967296.0 + limbs[ i ];
+        return negative ? -d : d;
+    }
+
+    std::string to_string() const
+    {
+        if ( limbs.empty() )
+            return "0";
+        std::string digits;
+        limbs_t m = limbs;
+        while ( ! m.empty() ) {
+            limb_t chunk = div_small( m, 1000000000 );
+            for ( int i = 0; i < 9 && ( chunk != 0 || ! m.empty() ); i++ ) {
+                digits.push_back( char( '0' + chunk % 10 ) );
+                chunk /= 10;
+            }
+        }
+        if ( negative )
+            digits.push_back( '-' );
+        std::reverse( digits.begin(), digits.end() );
+        return digits;
+    }
+
+    std::size_t hash() const
+    {
+        std::size_t h = negative;
+        for ( limb_t l : limbs )
+            h = h * 1000003 + std::hash< limb_t >()( l );
+        return h;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Arithmetic
+    ///////////////////////////////////////////////////////////////////////////
+
+    bigint operator -() const
+    {
+        bigint result = *this;
+        result.negative = ! negative && ! limbs.empty();
+        return result;
+    }
+
+    friend bigint operator +( const bigint& a, const bigint& b )
+    {
+        if ( a.negative == b.negative )
+            return make( a.negative, add_mag( a.limbs, b.limbs ) );
+        if ( cmp_mag( a.limbs, b.limbs ) >= 0 )
+            return make( a.negative, sub_mag( a.limbs, b.limbs ) );
+        return make( b.negative, sub_mag( b.limbs, a.limbs ) );
+    }
+
+    friend bigint operator -( const bigint& a, const bigint& b )
+    {
+        return a + -b;
+    }
+
+    friend bigint operator *( const bigint& a, const bigint& b )
+    {
+        return make( a.negative != b.negative, mul_mag( a.limbs, b.limbs ) );
+    }
+
+    friend bigint operator /( const bigint& a, const bigint& b )
+    {
+        limbs_t q, r;
+        divmod_mag( a.limbs, b.limbs, q, r );
+        return make( a.negative != b.negative, std::move( q ) );
+    }
+
+    friend bigint operator %( const bigint& a, const bigint& b )
+    {
+        limbs_t q, r;
+        divmod_mag( a.limbs, b.limbs, q, r );
+        return make( a.negative, std::move( r ) );
+    }
+
+    friend bool operator ==( const bigint& a, const bigint& b )
+    {
+        return a.negative == b.negative && a.limbs == b.limbs;
+    }
+
+    friend bool operator !=( const bigint& a, const bigint& b ) { return ! ( a == b ); }
+
+    friend bool operator <( const bigint& a, const bigint& b )
+    {
+        if ( a.negative != b.negative )
+            return a.negative;
+        int c = cmp_mag( a.limbs, b.limbs );
+        return a.negative ? c > 0 : c < 0;
+    }
+
+    friend std::ostream& operator <<( std::ostream& os, const bigint& b )
+    {
+        return os << b.to_string();
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Magnitudes
+    ///////////////////////////////////////////////////////////////////////////
+
+    static bigint make( bool negative, limbs_t limbs )
+    {
+        trim( limbs );
+        bigint result;
+        result.negative = negative && ! limbs.empty();
+        result.limbs = std::move( limbs );
+        return result;
+    }
+
+    static void trim( limbs_t& a )
+    {
+        while ( ! a.empty() && a.back() == 0 )
+            a.pop_back();
+    }
+
+    wide_t magnitude64() const
+    {
+        wide_t m = 0;
+        for ( std::size_t i = limbs.size(); i-- > 0; )
+            m = ( m << 32 ) | limbs[ i ];
+        return m;
+    }
+
+    static int cmp_mag( const limbs_t& a, const limbs_t& b )
+    {
+        if ( a.size() != b.size() )
+            return a.size() < b.size() ? -1 : 1;
+        for ( std::size_t i = a.size(); i-- > 0; )
+            if ( a[ i ] != b[ i ] )
+                return a[ i ] < b[ i ] ? -1 : 1;
+        return 0;
+    }
+
+    static limbs_t add_mag( const limbs_t& a, const limbs_t& b )
+    {
+        const limbs_t& longer = a.size() >= b.size() ? a : b;
+        const limbs_t& shorter = a.size() >= b.size() ? b : a;
+        limbs_t result( longer.size() + 1 );
+        wide_t carry = 0;
+        for ( std::size_t i = 0; i < longer.size(); i++ ) {
+            carry += wide_t( longer[ i ] ) + ( i < shorter.size() ? shorter[ i ] : 0 );
+            result[ i ] = limb_t( carry );
+            carry >>= 32;
+        }
+        result.back() = limb_t( carry );
+        trim( result );
+        return result;
+    }
+
+    /** Requires |a| >= |b|. **/
+    static limbs_t sub_mag( const limbs_t& a, const limbs_t& b )
+    {
+        limbs_t result( a.size() );
+        std::int64_t borrow = 0;
+        for ( std::size_t i = 0; i < a.size(); i++ ) {
+            std::int64_t d = std::int64_t( a[ i ] ) - borrow - ( i < b.size() ? b[ i ] : 0 );
+            borrow = d < 0;
+            result[ i ] = limb_t( d + ( borrow << 32 ) );
+        }
+        trim( result );
+        return result;
+    }
+
+    /** a += b * 2^( 32 * shift ), a is long enough to hold the sum. **/
+    static void add_shifted( limbs_t& a, const limbs_t& b, std::size_t shift )
+    {
+        wide_t carry = 0;
+        std::size_t i = 0;
+        for ( ; i < b.size(); i++ ) {
+            carry += wide_t( a[ i + shift ] ) + b[ i ];
+            a[ i + shift ] = limb_t( carry );
+            carry >>= 32;
+        }
+        for ( i += shift; carry != 0; i++ ) {
+            carry += a[ i ];
+            a[ i ] = limb_t( carry );
+            carry >>= 32;
+        }
+    }
+
+    static limbs_t mul_schoolbook( const limbs_t& a, const limbs_t& b )
+    {
+        limbs_t result( a.size() + b.size() );
+        for ( std::size_t i = 0; i < a.size(); i++ ) {
+            wide_t carry = 0;
+            for ( std::size_t j = 0; j < b.size(); j++ ) {
+                carry += wide_t( a[ i ] ) * b[ j ] + result[ i + j ];
+                result[ i + j ] = limb_t( carry );
+                carry >>= 32;
+            }
+            result[ i + b.size() ] = limb_t( carry );
+        }
+        trim( result );
+        return result;
+    }
+
+    static limbs_t low( const limbs_t& a, std::size_t n )
+    {
+        limbs_t result( a.begin(), a.begin() + std::min( n, a.size() ) );
+        trim( result );
+        return result;
+    }
+
+    static limbs_t high( const limbs_t& a, std::size_t n )
+    {
+        return n < a.size() ? limbs_t( a.begin() + n, a.end() ) : limbs_t();
+    }
+
+    /** Karatsuba, with a = a1 B + a0 and b = b1 B + b0 the product is
+     *  a1 b1 B^2 + ( ( a0 + a1 )( b0 + b1 ) - a0 b0 - a1 b1 ) B + a0 b0,
+     *  three half-size products instead of four. An operand shorter than
+     *  the split is multiplied with both halves of the other one. **/
+    static limbs_t mul_mag( const limbs_t& a, const limbs_t& b )
+    {
+        if ( a.empty() || b.empty() )
+            return {};
+        if ( std::min( a.size(), b.size() ) < karatsuba_threshold )
+            return mul_schoolbook( a, b );
+
+        std::size_t half = std::max( a.size(), b.size() ) / 2;
+        limbs_t result( a.size() + b.size() + 1 );
+
+        if ( std::min( a.size(), b.size() ) <= half ) {
+            const limbs_t& longer = a.size() > b.size() ? a : b;
+            const limbs_t& shorter = a.size() > b.size() ? b : a;
+            add_shifted( result, mul_mag( low( longer, half ), shorter ), 0 );
+            add_shifted( result, mul_mag( high( longer, half ), shorter ), half );
+        } else {
+            limbs_t a0 = low( a, half ), a1 = high( a, half );
+            limbs_t b0 = low( b, half ), b1 = high( b, half );
+            limbs_t z0 = mul_mag( a0, b0 );
+            limbs_t z2 = mul_mag( a1, b1 );
+            limbs_t z1 = mul_mag( add_mag( a0, a1 ), add_mag( b0, b1 ) );
+            z1 = sub_mag( sub_mag( z1, z0 ), z2 );
+            add_shifted( result, z0, 0 );
+            add_shifted( result, z1, half );
+            add_shifted( result, z2, 2 * half );
+        }
+        trim( result );
+        return result;
+    }
+
+    static void mul_add_small( limbs_t& a, limb_t factor, limb_t addend )
+    {
+        wide_t carry = addend;
+        for ( limb_t& l : a ) {
+            carry += wide_t( l ) * factor;
+            l = limb_t( carry );
+            carry >>= 32;
+        }
+        if ( carry != 0 )
+            a.push_back( limb_t( carry ) );
+    }
+
+    /** Divides a in place, returns the remainder. **/
+    static limb_t div_small( limbs_t& a, limb_t divisor )
+    {
+        wide_t rest = 0;
+        for ( std::size_t i = a.size(); i-- > 0; ) {
+            wide_t current = ( rest << 32 ) | a[ i ];
+            a[ i ] = limb_t( current / divisor );
+            rest = current % divisor;
+        }
+        trim( a );
+        return limb_t( rest );
+    }
+
+    /** Long division, algorithm D from Knuth, TAOCP vol. 2, 4.3.1. The
+     *  operands are shifted so that the top limb of the divisor has its high
+     *  bit set, the estimated quotient limb is then off by at most two. **/
+    static void divmod_mag( const limbs_t& u, const limbs_t& v, limbs_t& q, limbs_t& r )
+    {
+        if ( v.empty() )
+            throw std::runtime_error( "division by zero" );
+        if ( cmp_mag( u, v ) < 0 ) {
+            q.clear();
+            r = u;
+            return;
+        }
+        if ( v.size() == 1 ) {
+            q = u;
+            limb_t rest = div_small( q, v[ 0 ] );
+            r = rest ? limbs_t{ rest } : limbs_t{};
+            return;
+        }
+
+        const wide_t base = wide_t( 1 ) << 32;
+        std::size_t n = v.size();
+        std::size_t m = u.size() - n;
+        int s = __builtin_clz( v.back() );
+
+        limbs_t vn( n ), un( u.size() + 1 );
+        for ( std::size_t i = n; i-- > 0; )
+            vn[ i ] = limb_t( ( wide_t( v[ i ] ) << s )
+                            | ( i > 0 ? wide_t( v[ i - 1 ] ) >> ( 32 - s ) : 0 ) );
+        un[ u.size() ] = limb_t( wide_t( u.back() ) >> ( 32 - s ) );
+        for ( std::size_t i = u.size(); i-- > 0; )
+            un[ i ] = limb_t( ( wide_t( u[ i ] ) << s )
+                            | ( i > 0 ? wide_t( u[ i - 1 ] ) >> ( 32 - s ) : 0 ) );
+
+        q.assign( m + 1, 0 );
+        for ( std::size_t j = m + 1; j-- > 0; ) {
+            wide_t top = ( wide_t( un[ j + n ] ) << 32 ) | un[ j + n - 1 ];
+            wide_t qhat = top / vn[ n - 1 ];
+            wide_t rhat = top % vn[ n - 1 ];
+            while ( qhat >= base || qhat * vn[ n - 2 ] > ( ( rhat << 32 ) | un[ j + n - 2 ] ) ) {
+                qhat--;
+                rhat += vn[ n - 1 ];
+                if ( rhat >= base )
+                    break;
+            }
+
+            std::int64_t borrow = 0;
+            for ( std::size_t i = 0; i < n; i++ ) {
+                wide_t p = qhat * vn[ i ];
+                std::int64_t t = std::int64_t( un[ i + j ] ) - borrow - std::int64_t( p & 0xffffffff );
+                un[ i + j ] = limb_t( t );
+                borrow = std::int64_t( p >> 32 ) - ( t >> 32 );
+            }
+            std::int64_t t = std::int64_t( un[ j + n ] ) - borrow;
+            un[ j + n ] = limb_t( t );
+
+            q[ j ] = limb_t( qhat );
+            if ( t < 0 ) {
+                // the estimate was one too large, add the divisor back
+                q[ j ]--;
+                wide_t carry = 0;
+                for ( std::size_t i = 0; i < n; i++ ) {
+                    carry += wide_t( un[ i + j ] ) + vn[ i ];
+                    un[ i + j ] = limb_t( carry );
+                    carry >>= 32;
+                }
+                un[ j + n ] += limb_t( carry );
+            }
+        }
+
+        r.assign( n, 0 );
+        for ( std::size_t i = 0; i < n; i++ )
+            r[ i ] = limb_t( ( wide_t( un[ i ] ) >> s ) | ( wide_t( un[ i + 1 ] ) << ( 32 - s ) ) );
+        trim( q );
+        trim( r );
+    }
+};
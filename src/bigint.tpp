@@ -0,0 +1,94 @@
+#include <cassert>
+#include <cstdint>
+#include <string>
+
+#include "bigint.hpp"
+
+using i128 = __int128;
+
+std::string show( i128 v )
+{
+    if ( v == 0 )
+        return "0";
+    bool negative = v < 0;
+    unsigned __int128 m = negative ? -( unsigned __int128 )( v ) : v;
+    std::string s;
+    for ( ; m != 0; m /= 10 )
+        s.insert( s.begin(), char( '0' + int( m % 10 ) ) );
+    return negative ? "-" + s : s;
+}
+
+bigint big( i128 v )
+{
+    return bigint::from_string( show( v ) );
+}
+
+void test_small()
+{
+    const std::int64_t samples[] = { 0, 1, -1, 7, -13, 1000000007, -4294967296
+                                   , INT64_MAX, INT64_MIN, INT64_MAX / 3, INT64_MIN / 5 };
+    for ( i128 a : samples )
+        for ( i128 b : samples ) {
+            assert( ( big( a ) + big( b ) ).to_string() == show( a + b ) );
+            assert( ( big( a ) - big( b ) ).to_string() == show( a - b ) );
+            assert( ( big( a ) * bigint( std::int64_t( b ) ) ).to_string() == show( a * b ) );
+            assert( ( big( a ) < big( b ) ) == ( a < b ) );
+            if ( b != 0 ) {
+                assert( ( big( a ) / big( b ) ).to_string() == show( a / b ) );
+                assert( ( big( a ) % big( b ) ).to_string() == show( a % b ) );
+            }
+        }
+}
+
+void test_int64()
+{
+    assert( bigint( INT64_MIN ).fits_int64() && bigint( INT64_MIN ).to_int64() == INT64_MIN );
+    assert( bigint( INT64_MAX ).to_int64() == INT64_MAX );
+    assert( ! ( bigint( INT64_MAX ) + bigint( 1 ) ).fits_int64() );
+    assert( ! ( bigint( INT64_MIN ) - bigint( 1 ) ).fits_int64() );
+    assert( ( bigint( INT64_MIN ) / bigint( -1 ) ).to_string() == "9223372036854775808" );
+    assert( ( -bigint( 0 ) ) == bigint( 0 ) );
+}
+
+/** 3^n by repeated squaring against a product of the digits. **/
+bigint power( bigint b, int n )
+{
+    bigint result( 1 );
+    for ( ; n > 0; n /= 2 ) {
+        if ( n % 2 )
+            result = result * b;
+        b = b * b;
+    }
+    return result;
+}
+
+void test_large()
+{
+    bigint p = power( bigint( 3 ), 5000 );
+    bigint q = power( bigint( 7 ), 3000 );
+    assert( p.limbs.size() > 2 * bigint::karatsuba_threshold );
+
+    // karatsuba against schoolbook
+    assert( bigint::mul_mag( p.limbs, q.limbs ) == bigint::mul_schoolbook( p.limbs, q.limbs ) );
+    assert( bigint::mul_mag( p.limbs, p.limbs ) == bigint::mul_schoolbook( p.limbs, p.limbs ) );
+
+    bigint pq = p * q;
+    assert( pq / q == p && pq % q == bigint() );
+    assert( ( pq + bigint( 5 ) ) % p == bigint( 5 ) );
+
+    bigint r = p * bigint( 1000003 ) + bigint( 12345 );
+    bigint d = r / q;
+    bigint m = r % q;
+    assert( d * q + m == r && m < q );
+    assert( ( -r ) / q == -d && ( -r ) % q == -m );
+
+    assert( bigint::from_string( p.to_string() ) == p );
+    assert( power( bigint( 10 ), 30 ).to_string() == "1" + std::string( 30, '0' ) );
+}
+
+int main()
+{
+    test_small();
+    test_int64();
+    test_large();
+}
@@ -1,4 +1,9 @@
+#pragma once
+
+#include <sstream>
+
 #include "kocky.hpp"
+#include "kernels.hpp"
 #include "values.hpp"
 
 template < typename eval_t >
@@ -19,19 +24,138 @@ struct builtins
         return object_t( function_object< evaluable_t >( { std::move( path ) }, 2 ) );
     };
 
-    static void int_binary( eval_t& e, std::function< int( int, int ) > f )
+    static bigint to_bigint( const object_t& o )
+    {
+        if ( o.template has_value< int_t >() )
+            return bigint( o.template get_value< int_t >() );
+        return o.template get_value< bigint >();
+    }
+
+    /** Int values are kept in int_t whenever they fit, so that every Int has
+     *  a single representation. **/
+    static object_t from_bigint( const bigint& b )
+    {
+        return b.fits_int64() ? object_t( b.to_int64() ) : object_t( b );
+    }
+
+    static bool is_int( const object_t& o )
+    {
+        return o.template has_value< int_t >() || o.template has_value< bigint >();
+    }
+
+    static double to_double( const object_t& o )
+    {
+        if ( o.template has_value< double >() )
+            return o.template get_value< double >();
+        if ( o.template has_value< int_t >() )
+            return double( o.template get_value< int_t >() );
+        if ( ! o.template has_value< bigint >() )
+            throw std::runtime_error( "expected Int or Float but got "s + o.to_string() );
+        return o.template get_value< bigint >().to_double();
+    }
+
+    static object_t wrapper_num_binary( evaluable_t e ) {
+        function_path< evaluable_t > path(
+                { variable_pattern( "a" ), variable_pattern( "b" ) },
+                variable_pattern( "_" )
+                , e );
+        return object_t( function_object< evaluable_t >( { std::move( path ) }, 2 ) );
+    };
+
+    /** Arithmetic on Int and Float, dispatched on the alternatives of the
+     *  values. Two small Ints are computed in int_t, `small` reports an
+     *  overflow by returning false and the operation is then repeated in
+     *  bigint. If either operand is a Float, both are computed as doubles. **/
+    template < typename small_t, typename big_t, typename float_op_t >
+    static void num_binary( eval_t& e, small_t small, big_t big, float_op_t float_op )
     {
         object_t a = e.state._store.lookup( "a" );
         object_t b = e.state._store.lookup( "b" );
-        e.state.push_value( object_t( f( a.template get_value< int >()
-                                       , b.template get_value< int >() ) ) );
+        if ( a.template has_value< int_t >() && b.template has_value< int_t >() ) {
+            int_t result;
+            if ( small( a.template get_value< int_t >(), b.template get_value< int_t >(), result ) ) {
+                e.state.push_value( object_t( result ) );
+                return;
+            }
+        }
+        if ( is_int( a ) && is_int( b ) ) {
+            e.state.push_value( from_bigint( big( to_bigint( a ), to_bigint( b ) ) ) );
+            return;
+        }
+        if ( ( is_int( a ) || a.template has_value< double >() )
+          && ( is_int( b ) || b.template has_value< double >() ) ) {
+            e.state.push_value( object_t( float_op( to_double( a ), to_double( b ) ) ) );
+            return;
+        }
+        throw std::runtime_error( "expected Int or Float operands but got "s
+                                + a.to_string() + " and " + b.to_string() );
     }
 
-    static void add( eval_t& e ) { int_binary( e, []( int a, int b ){ return a + b; } ); }
-    static void sub( eval_t& e ) { int_binary( e, []( int a, int b ){ return a - b; } ); }
-    static void mul( eval_t& e ) { int_binary( e, []( int a, int b ){ return a * b; } ); }
-    static void div( eval_t& e ) { int_binary( e, []( int a, int b ){ return a / b; } ); }
-    static void mod( eval_t& e ) { int_binary( e, []( int a, int b ){ return a % b; } ); }
+    static void add( eval_t& e )
+    {
+        num_binary( e, []( int_t a, int_t b, int_t& r ){ return ! __builtin_add_overflow( a, b, &r ); }
+                     , []( const bigint& a, const bigint& b ){ return a + b; }
+                     , []( double a, double b ){ return a + b; } );
+    }
+
+    static void sub( eval_t& e )
+    {
+        num_binary( e, []( int_t a, int_t b, int_t& r ){ return ! __builtin_sub_overflow( a, b, &r ); }
+                     , []( const bigint& a, const bigint& b ){ return a - b; }
+                     , []( double a, double b ){ return a - b; } );
+    }
+
+    static void mul( eval_t& e )
+    {
+        num_binary( e, []( int_t a, int_t b, int_t& r ){ return ! __builtin_mul_overflow( a, b, &r ); }
+                     , []( const bigint& a, const bigint& b ){ return a * b; }
+                     , []( double a, double b ){ return a * b; } );
+    }
+
+    /** Division by zero and the quotient of the minimum by -1 are left to
+     *  bigint, which throws or promotes. **/
+    static bool int_divisible( int_t a, int_t b )
+    {
+        return b != 0 && ! ( a == std::numeric_limits< int_t >::min() && b == -1 );
+    }
+
+    static void div( eval_t& e )
+    {
+        num_binary( e, []( int_t a, int_t b, int_t& r ){ return int_divisible( a, b ) && ( r = a / b, true ); }
+                     , []( const bigint& a, const bigint& b ){ return a / b; }
+                     , []( double a, double b ){ return a / b; } );
+    }
+
+    static void mod( eval_t& e )
+    {
+        num_binary( e, []( int_t a, int_t b, int_t& r ){ return int_divisible( a, b ) && ( r = a % b, true ); }
+                     , []( const bigint& a, const bigint& b ){ return a % b; }
+                     , []( double a, double b ){ return std::fmod( a, b ); } );
+    }
+
+    static void to_float( eval_t& e )
+    {
+        e.state.push_value( object_t( to_double( e.state._store.lookup( "a" ) ) ) );
+    }
+
+    /** Rounds towards zero. **/
+    static void truncate( eval_t& e )
+    {
+        double a = e.state._store.lookup( "a" ).template get_value< double >();
+        if ( ! ( std::fabs( a ) < 9.2e18 ) )
+            throw std::runtime_error( "can not truncate " + std::to_string( a ) + " to an Int" );
+        e.state.push_value( object_t( int_t( a ) ) );
+    }
+
+    static void f_sqrt( eval_t& e )
+    {
+        e.state.push_value( object_t( std::sqrt( e.state._store.lookup( "a" ).template get_value< double >() ) ) );
+    }
+
+    static void f_exp( eval_t& e )
+    {
+        e.state.push_value( object_t( std::exp( e.state._store.lookup( "a" ).template get_value< double >() ) ) );
+    }
 
     static object_t wrapper_any_unary( evaluable_t e ) {
         using object_t = typename eval_t::object_t;
@@ -48,26 +172,1046 @@ struct builtins
         e.state.push_value( a );
     }
 
-    static object_t bool_binary_o( evaluable_t e ) {
+    /** The second argument is a thunk, it is forced only if the first one
+     *  does not decide the result. **/
+    static object_t bool_lazy_o( evaluable_t e ) {
         using object_t = typename eval_t::object_t;
         function_path< evaluable_t > path( 
                 { object_pattern( "Bool", { variable_pattern( "a" ) } )
-                , object_pattern( "Bool", { variable_pattern( "b" ) } ) }, 
+                , variable_pattern( "b" ) }, 
                 variable_pattern( "_" )
                 , e );
-        return object_t( function_object< evaluable_t >( { std::move( path ) }, 2 ) );
+        function_object< evaluable_t > fun( { std::move( path ) }, 2 );
+        fun.lazy_args = { false, true };
+        return object_t( std::move( fun ) );
     };
 
-    static void bool_binary( eval_t& e, std::function< bool( bool, bool ) > f )
+    static void bool_lazy( eval_t& e, bool decisive )
     {
+        using thunk_t = typename eval_t::types::thunk_t;
         object_t a = e.state._store.lookup( "a" );
-        object_t b = e.state._store.lookup( "b" );
-        e.state.push_value( object_t( f( a.template get_value< bool >()
-                                       , b.template get_value< bool >() ) ) );
+        if ( a.template get_value< bool >() == decisive ) {
+            e.state.push_value( a );
+            return;
+        }
+        e.state.push_cell( bool_check< eval_t >() );
+        e.force( e.state._store.lookup( "b" ).template get_value< thunk_t >() );
+    }
+
+    static void b_and( eval_t& e ) { bool_lazy( e, false ); }
+    static void b_or( eval_t& e ) { bool_lazy( e, true ); }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Streams
+    ///////////////////////////////////////////////////////////////////////////
+
+    using fun_obj_t = typename eval_t::types::fun_obj_t;
+    using stream_t  = typename eval_t::types::stream_t;
+    using stream_node_t = typename stream_t::node_t;
+    using attrs_t = typename object_t::attrs_t;
+
+    /** Builtin with the given input patterns, the i-th argument is bound to
+     *  the variable in the i-th pattern. **/
+    static builtin_wrapper signature( std::vector< pattern > inputs )
+    {
+        return [ inputs ]( evaluable_t e ) {
+            int arity = inputs.size();
+            function_path< evaluable_t > path( inputs, variable_pattern( "_" ), e );
+            return object_t( function_object< evaluable_t >( { std::move( path ) }, arity ) );
+        };
+    }
+
+    static pattern typed( const char* type, const char* name )
+    {
+        return object_pattern( type, { variable_pattern( name ) } );
+    }
+
+    template < typename T >
+    static T arg( eval_t& e, const identifier_t& name )
+    {
+        return e.state._store.lookup( name ).template get_value< T >();
+    }
+
+    /** Int argument of a builtin, which needs it as a machine integer. **/
+    static int_t int_arg( eval_t& e, const identifier_t& name )
+    {
+        object_t o = e.state._store.lookup( name );
+        if ( ! o.template has_value< int_t >() )
+            throw std::runtime_error( "argument "s + name + " is out of range" );
+        return o.template get_value< int_t >();
+    }
+
+    /** Moves the argument out of the store, if the caller passed the last
+     *  use of the value, the builtin then holds the only reference. **/
+    template < typename T >
+    static T take( eval_t& e, const identifier_t& name )
+    {
+        return e.state._store.take( name ).template get_value< T >();
+    }
+
+    static object_t nil() { return object_t( "Nil", attrs_t{} ); }
+
+    static object_t cons( object_t head, object_t tail )
+    {
+        return object_t( "Cons", attrs_t{ std::move( head ), std::move( tail ) } );
+    }
+
+    static bool is_nil( const object_t& o )
+    {
+        return o.name == "Nil" && ! o.omega() && o.get_attrs().empty();
+    }
+
+    static const attrs_t& get_cons( const object_t& o )
+    {
+        if ( o.name != "Cons" || o.omega() || o.get_attrs().size() != 2 )
+            throw std::runtime_error( "expected < Nil > or < Cons x xs > but got "s + o.to_string() );
+        return o.get_attrs();
     }
 
-    static void b_and( eval_t& e ) { bool_binary( e, []( int a, int b ){ return a && b; } ); }
-    static void b_or( eval_t& e ) { bool_binary( e, []( int a, int b ){ return a || b; } ); }
+    /** Pushes the next step of the stream, which is either < Nil > or
+     *  < Cons x rest > where rest is a Stream. **/
+    static void pull( eval_t& e, const stream_t& s )
+    {
+        std::visit( [&]( const auto& kind ){ pull( e, kind ); }, s.node->kind );
+    }
+
+    static void pull( eval_t& e, const typename stream_node_t::range& r )
+    {
+        if ( r.from >= r.to ) {
+            e.state.push_value( nil() );
+            return;
+        }
+        e.state.push_value( cons( object_t( r.from )
+                                , object_t( stream_t::make( typename stream_node_t::range{ r.from + 1, r.to } ) ) ) );
+    }
+
+    static void pull( eval_t& e, const typename stream_node_t::unfold& u )
+    {
+        fun_obj_t step = u.step;
+        e.push_native( [ step ]( eval_t& e ) {
+            object_t r = e.state.pop_value();
+            if ( is_nil( r ) ) {
+                e.state.push_value( std::move( r ) );
+                return;
+            }
+            const attrs_t& c = get_cons( r );
+            e.state.push_value( cons( c[ 0 ], object_t( stream_t::make( typename stream_node_t::unfold{ step, c[ 1 ] } ) ) ) );
+        } );
+        e.call( u.step, { u.seed } );
+    }
+
+    static void pull( eval_t& e, const typename stream_node_t::map& m )
+    {
+        fun_obj_t fun = m.fun;
+        e.push_native( [ fun ]( eval_t& e ) {
+            object_t r = e.state.pop_value();
+            if ( is_nil( r ) ) {
+                e.state.push_value( std::move( r ) );
+                return;
+            }
+            const attrs_t& c = get_cons( r );
+            stream_t rest = c[ 1 ].template get_value< stream_t >();
+            e.push_native( [ fun, rest ]( eval_t& e ) {
+                object_t y = e.state.pop_value();
+                e.state.push_value( cons( std::move( y ), object_t( stream_t::make( typename stream_node_t::map{ fun, rest } ) ) ) );
+            } );
+            e.call( fun, { c[ 0 ] } );
+        } );
+        pull( e, m.source );
+    }
+
+    static void pull( eval_t& e, const typename stream_node_t::filter& f )
+    {
+        fun_obj_t predicate = f.predicate;
+        e.push_native( [ predicate ]( eval_t& e ) {
+            object_t r = e.state.pop_value();
+            if ( is_nil( r ) ) {
+                e.state.push_value( std::move( r ) );
+                return;
+            }
+            const attrs_t& c = get_cons( r );
+            object_t x = c[ 0 ];
+            stream_t rest = stream_t::make( typename stream_node_t::filter{
+                    predicate, c[ 1 ].template get_value< stream_t >() } );
+            e.push_native( [ x, rest ]( eval_t& e ) {
+                object_t keep = e.state.pop_value();
+                if ( ! keep.template has_value< bool >() )
+                    throw std::runtime_error( "predicate result is not a Bool: "s + keep.to_string() );
+                if ( keep.template get_value< bool >() )
+                    e.state.push_value( cons( x, object_t( rest ) ) );
+                else
+                    pull( e, rest );
+            } );
+            e.call( predicate, { std::move( x ) } );
+        } );
+        pull( e, f.source );
+    }
+
+    static void pull( eval_t& e, const typename stream_node_t::take& t )
+    {
+        if ( t.count <= 0 ) {
+            e.state.push_value( nil() );
+            return;
+        }
+        int_t count = t.count;
+        e.push_native( [ count ]( eval_t& e ) {
+            object_t r = e.state.pop_value();
+            if ( is_nil( r ) ) {
+                e.state.push_value( std::move( r ) );
+                return;
+            }
+            const attrs_t& c = get_cons( r );
+            e.state.push_value( cons( c[ 0 ], object_t( stream_t::make( typename stream_node_t::take{
+                    count - 1, c[ 1 ].template get_value< stream_t >() } ) ) ) );
+        } );
+        pull( e, t.source );
+    }
+
+    static void fold_step( eval_t& e, fun_obj_t fun, object_t acc )
+    {
+        e.push_native( [ fun, acc ]( eval_t& e ) {
+            object_t r = e.state.pop_value();
+            if ( is_nil( r ) ) {
+                e.state.push_value( acc );
+                return;
+            }
+            const attrs_t& c = get_cons( r );
+            stream_t rest = c[ 1 ].template get_value< stream_t >();
+            e.push_native( [ fun, rest ]( eval_t& e ) {
+                fold_step( e, fun, e.state.pop_value() );
+                pull( e, rest );
+            } );
+            e.call( fun, { acc, c[ 0 ] } );
+        } );
+    }
+
+    static void s_range( eval_t& e )
+    {
+        e.state.push_value( object_t( stream_t::make( typename stream_node_t::range{
+                int_arg( e, "a" ), int_arg( e, "b" ) } ) ) );
+    }
+
+    static void s_unfold( eval_t& e )
+    {
+        e.state.push_value( object_t( stream_t::make( typename stream_node_t::unfold{
+                arg< fun_obj_t >( e, "f" ), e.state._store.lookup( "x" ) } ) ) );
+    }
+
+    /** A Stream is mapped lazily, an array in a native loop. **/
+    static void s_map( eval_t& e )
+    {
+        object_t s = e.state._store.take( "s" );
+        if ( s.template has_value< int_array_t >() )
+            return map_loop( e, arg< fun_obj_t >( e, "f" ), s.template get_value< int_array_t >() );
+        if ( s.template has_value< float_array_t >() )
+            return map_loop( e, arg< fun_obj_t >( e, "f" ), s.template get_value< float_array_t >() );
+        if ( ! s.template has_value< stream_t >() )
+            throw std::runtime_error( "expected a Stream or an array but got "s + s.to_string() );
+        e.state.push_value( object_t( stream_t::make( typename stream_node_t::map{
+                arg< fun_obj_t >( e, "f" ), s.template get_value< stream_t >() } ) ) );
+    }
+
+    static void s_filter( eval_t& e )
+    {
+        e.state.push_value( object_t( stream_t::make( typename stream_node_t::filter{
+                arg< fun_obj_t >( e, "f" ), arg< stream_t >( e, "s" ) } ) ) );
+    }
+
+    static void s_take( eval_t& e )
+    {
+        e.state.push_value( object_t( stream_t::make( typename stream_node_t::take{
+                int_arg( e, "n" ), arg< stream_t >( e, "s" ) } ) ) );
+    }
+
+    static void s_uncons( eval_t& e )
+    {
+        pull( e, arg< stream_t >( e, "s" ) );
+    }
+
+    static void b_cons( eval_t& e )
+    {
+        e.state.push_value( cons( e.state._store.take( "a" ), e.state._store.take( "b" ) ) );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Arrays
+    ///////////////////////////////////////////////////////////////////////////
+
+    using int_array_t = typename eval_t::types::int_array_t;
+    using i64 = std::int64_t;
+
+    enum class array_op { add, sub, mul };
+
+    /** Bulk builtins take the arithmetic builtins as operators, any other
+     *  function can not be run by the kernels. **/
+    static array_op get_array_op( const fun_obj_t& fun )
+    {
+        using builtin_ptr = void (*)( eval_t& );
+
+        if ( fun.paths.size() == 1 )
+            if ( const auto* b = std::get_if< builtin_t >( &fun.paths[ 0 ].evaluable ) )
+                if ( const auto* f = b->template target< builtin_ptr >() ) {
+                    if ( *f == add ) return array_op::add;
+                    if ( *f == sub ) return array_op::sub;
+                    if ( *f == mul ) return array_op::mul;
+                }
+        throw std::runtime_error( "expected + - or * as the array operator" );
+    }
+
+    static size_t array_index( eval_t& e, const char* name, size_t limit )
+    {
+        int_t i = int_arg( e, name );
+        if ( i < 0 || i > limit )
+            throw std::runtime_error( "array index " + std::to_string( i ) + " out of bounds" );
+        return i;
+    }
+
+    static void a_make( eval_t& e )
+    {
+        int_t n = int_arg( e, "n" );
+        if ( n < 0 )
+            throw std::runtime_error( "negative array size" );
+        e.state.push_value( object_t( int_array_t( std::vector< i64 >( n, int_arg( e, "x" ) ) ) ) );
+    }
+
+    static void a_range( eval_t& e )
+    {
+        int_t from = int_arg( e, "a" );
+        int_t to = int_arg( e, "b" );
+        std::vector< i64 > values;
+        for ( i64 i = from; i < to; i++ )
+            values.push_back( i );
+        e.state.push_value( object_t( int_array_t( std::move( values ) ) ) );
+    }
+
+    static void a_from_step( eval_t& e, std::shared_ptr< std::vector< i64 > > values )
+    {
+        e.push_native( [ values ]( eval_t& e ) {
+            object_t r = e.state.pop_value();
+            if ( is_nil( r ) ) {
+                e.state.push_value( object_t( int_array_t( std::move( *values ) ) ) );
+                return;
+            }
+            const attrs_t& c = get_cons( r );
+            values->push_back( c[ 0 ].template get_value< int_t >() );
+            a_from_step( e, values );
+            pull( e, c[ 1 ].template get_value< stream_t >() );
+        } );
+    }
+
+    static void a_from( eval_t& e )
+    {
+        a_from_step( e, std::make_shared< std::vector< i64 > >() );
+        pull( e, arg< stream_t >( e, "s" ) );
+    }
+
+    static void a_length( eval_t& e )
+    {
+        e.state.push_value( object_t( int_t( arg< int_array_t >( e, "a" ).size() ) ) );
+    }
+
+    static void a_get( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        if ( a.size() == 0 )
+            throw std::runtime_error( "index to an empty array" );
+        e.state.push_value( object_t( int_t( a[ array_index( e, "i", a.size() - 1 ) ] ) ) );
+    }
+
+    static void a_slice( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        size_t to = array_index( e, "j", a.size() );
+        size_t from = array_index( e, "i", to );
+        e.state.push_value( object_t( a.slice( from, to ) ) );
+    }
+
+    /** The result of a bulk operation, the input itself when no other
+     *  value shares its buffer, a fresh array otherwise. The kernels allow
+     *  the output to alias the input. **/
+    template < typename array_t >
+    static array_t array_output( const array_t& a )
+    {
+        if ( a.unique() )
+            return a;
+        return array_t( typename array_t::buffer_t( a.size() ) );
+    }
+
+    /** The elements are machine integers, a result, which does not fit, is
+     *  an error, while a reduction is promoted, see exact_sum. **/
+    static void check_elements( bool fits )
+    {
+        if ( ! fits )
+            throw std::runtime_error( "an element of the array is out of range" );
+    }
+
+    static bigint to_bigint( __int128 v )
+    {
+        bigint low_bits( std::int64_t( std::uint64_t( v ) >> 32 ) );
+        return bigint( std::int64_t( v >> 64 ) ) * bigint( std::int64_t( 1 ) << 32 ) * bigint( std::int64_t( 1 ) << 32 )
+             + low_bits * bigint( std::int64_t( 1 ) << 32 )
+             + bigint( std::int64_t( std::uint64_t( v ) & 0xffffffff ) );
+    }
+
+    /** The sum of the terms, which overflowed int64 in the kernel. It is
+     *  added in __int128, which is carried to a bigint when it would
+     *  overflow too. **/
+    template < typename term_t >
+    static object_t exact_sum( size_t n, term_t term )
+    {
+        bigint carried;
+        __int128 total = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            __int128 t = term( i ), next;
+            if ( __builtin_add_overflow( total, t, &next ) ) {
+                carried = carried + to_bigint( total );
+                next = t;
+            }
+            total = next;
+        }
+        return from_bigint( carried + to_bigint( total ) );
+    }
+
+    static void a_set( eval_t& e )
+    {
+        int_array_t a = take< int_array_t >( e, "a" );
+        if ( a.size() == 0 )
+            throw std::runtime_error( "index to an empty array" );
+        size_t i = array_index( e, "i", a.size() - 1 );
+        if ( ! a.unique() )
+            a = int_array_t( std::vector< i64 >( a.data(), a.data() + a.size() ) );
+        a.mutable_data()[ i ] = int_arg( e, "x" );
+        e.state.push_value( object_t( std::move( a ) ) );
+    }
+
+    static void a_map( eval_t& e )
+    {
+        array_op op = get_array_op( arg< fun_obj_t >( e, "f" ) );
+        int_array_t a = take< int_array_t >( e, "a" );
+        i64 k = int_arg( e, "k" );
+        int_array_t out = array_output( a );
+        bool fits = true;
+        switch ( op ) {
+            case array_op::add: fits = kernels::add_scalar( a.data(), k, out.mutable_data(), a.size() ); break;
+            case array_op::sub: fits = kernels::sub_scalar( a.data(), k, out.mutable_data(), a.size() ); break;
+            case array_op::mul: fits = kernels::mul_scalar( a.data(), k, out.mutable_data(), a.size() ); break;
+        }
+        check_elements( fits );
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    static void a_zip( eval_t& e )
+    {
+        array_op op = get_array_op( arg< fun_obj_t >( e, "f" ) );
+        int_array_t a = take< int_array_t >( e, "a" );
+        int_array_t b = take< int_array_t >( e, "b" );
+        if ( a.size() != b.size() )
+            throw std::runtime_error( "arrays of different lengths" );
+        int_array_t out = b.unique() ? b : array_output( a );
+        bool fits = true;
+        switch ( op ) {
+            case array_op::add: fits = kernels::add( a.data(), b.data(), out.mutable_data(), a.size() ); break;
+            case array_op::sub: fits = kernels::sub( a.data(), b.data(), out.mutable_data(), a.size() ); break;
+            case array_op::mul: fits = kernels::mul( a.data(), b.data(), out.mutable_data(), a.size() ); break;
+        }
+        check_elements( fits );
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    static void a_sum( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        i64 total;
+        if ( kernels::sum( a.data(), a.size(), total ) )
+            e.state.push_value( object_t( int_t( total ) ) );
+        else
+            e.state.push_value( exact_sum( a.size(), [ & ]( size_t i ){ return __int128( a.data()[ i ] ); } ) );
+    }
+
+    static void a_min( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        if ( a.size() == 0 )
+            throw std::runtime_error( "minimum of an empty array" );
+        e.state.push_value( object_t( int_t( kernels::min( a.data(), a.size() ) ) ) );
+    }
+
+    static void a_max( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        if ( a.size() == 0 )
+            throw std::runtime_error( "maximum of an empty array" );
+        e.state.push_value( object_t( int_t( kernels::max( a.data(), a.size() ) ) ) );
+    }
+
+    static void a_dot( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        int_array_t b = arg< int_array_t >( e, "b" );
+        if ( a.size() != b.size() )
+            throw std::runtime_error( "arrays of different lengths" );
+        i64 total;
+        if ( kernels::dot( a.data(), b.data(), a.size(), total ) )
+            e.state.push_value( object_t( int_t( total ) ) );
+        else
+            e.state.push_value( exact_sum( a.size(), [ & ]( size_t i ){
+                return __int128( a.data()[ i ] ) * b.data()[ i ]; } ) );
+    }
+
+    static void a_scan( eval_t& e )
+    {
+        int_array_t a = take< int_array_t >( e, "a" );
+        int_array_t out = array_output( a );
+        check_elements( kernels::prefix_sum( a.data(), out.mutable_data(), a.size() ) );
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Float arrays
+    ///////////////////////////////////////////////////////////////////////////
+
+    using float_array_t = typename eval_t::types::float_array_t;
+
+    static double float_arg( eval_t& e, const identifier_t& name )
+    {
+        return e.state._store.lookup( name ).template get_value< double >();
+    }
+
+    static void f_make( eval_t& e )
+    {
+        int_t n = int_arg( e, "n" );
+        if ( n < 0 )
+            throw std::runtime_error( "negative array size" );
+        e.state.push_value( object_t( float_array_t( std::vector< double >( n, float_arg( e, "x" ) ) ) ) );
+    }
+
+    static void f_of( eval_t& e )
+    {
+        int_array_t a = arg< int_array_t >( e, "a" );
+        e.state.push_value( object_t( float_array_t( std::vector< double >( a.data(), a.data() + a.size() ) ) ) );
+    }
+
+    static void f_length( eval_t& e )
+    {
+        e.state.push_value( object_t( int_t( arg< float_array_t >( e, "a" ).size() ) ) );
+    }
+
+    static void f_get( eval_t& e )
+    {
+        float_array_t a = arg< float_array_t >( e, "a" );
+        if ( a.size() == 0 )
+            throw std::runtime_error( "index to an empty array" );
+        e.state.push_value( object_t( a[ array_index( e, "i", a.size() - 1 ) ] ) );
+    }
+
+    /** The scalar is converted to a Float, an Int works as well. **/
+    static void f_map( eval_t& e )
+    {
+        array_op op = get_array_op( arg< fun_obj_t >( e, "f" ) );
+        float_array_t a = take< float_array_t >( e, "a" );
+        double k = to_double( e.state._store.lookup( "k" ) );
+        float_array_t out = array_output( a );
+        switch ( op ) {
+            case array_op::add: kernels::add_scalar( a.data(), k, out.mutable_data(), a.size() ); break;
+            case array_op::sub: kernels::add_scalar( a.data(), -k, out.mutable_data(), a.size() ); break;
+            case array_op::mul: kernels::mul_scalar( a.data(), k, out.mutable_data(), a.size() ); break;
+        }
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    static void f_zip( eval_t& e )
+    {
+        array_op op = get_array_op( arg< fun_obj_t >( e, "f" ) );
+        float_array_t a = take< float_array_t >( e, "a" );
+        float_array_t b = take< float_array_t >( e, "b" );
+        if ( a.size() != b.size() )
+            throw std::runtime_error( "arrays of different lengths" );
+        float_array_t out = b.unique() ? b : array_output( a );
+        switch ( op ) {
+            case array_op::add: kernels::add( a.data(), b.data(), out.mutable_data(), a.size() ); break;
+            case array_op::sub: kernels::sub( a.data(), b.data(), out.mutable_data(), a.size() ); break;
+            case array_op::mul: kernels::mul( a.data(), b.data(), out.mutable_data(), a.size() ); break;
+        }
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    static void f_sum( eval_t& e )
+    {
+        float_array_t a = arg< float_array_t >( e, "a" );
+        e.state.push_value( object_t( kernels::sum( a.data(), a.size() ) ) );
+    }
+
+    static void f_dot( eval_t& e )
+    {
+        float_array_t a = arg< float_array_t >( e, "a" );
+        float_array_t b = arg< float_array_t >( e, "b" );
+        if ( a.size() != b.size() )
+            throw std::runtime_error( "arrays of different lengths" );
+        e.state.push_value( object_t( kernels::dot( a.data(), b.data(), a.size() ) ) );
+    }
+
+    static void f_sqrt_all( eval_t& e )
+    {
+        float_array_t a = take< float_array_t >( e, "a" );
+        float_array_t out = array_output( a );
+        kernels::sqrt( a.data(), out.mutable_data(), a.size() );
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    static void f_exp_all( eval_t& e )
+    {
+        float_array_t a = take< float_array_t >( e, "a" );
+        float_array_t out = array_output( a );
+        kernels::exp( a.data(), out.mutable_data(), a.size() );
+        e.state.push_value( object_t( std::move( out ) ) );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Loops
+    ///////////////////////////////////////////////////////////////////////////
+
+    using frame_t = typename eval_t::frame_t;
+
+    /** Folds the elements from the index on, the accumulator is on the value
+     *  stack. **/
+    template < typename element_t >
+    static void fold_loop( eval_t& e, fun_obj_t f, element_t element, std::size_t i, std::size_t size )
+    {
+        e.loop( std::move( f ), [ element, i, size ]( eval_t& e, frame_t& frame ) mutable {
+            if ( i == size )
+                return false;
+            object_t acc = e.state.pop_value();
+            e.call_in_frame( frame, std::move( acc ), element( i++ ) );
+            return true;
+        } );
+    }
+
+    /** foldl f x s, a range Stream, an Array and a FloatArray are folded in a
+     *  native loop, which calls f in a single frame. Other streams are
+     *  pulled. **/
+    static void l_foldl( eval_t& e )
+    {
+        fun_obj_t f = arg< fun_obj_t >( e, "f" );
+        object_t x = e.state._store.take( "x" );
+        object_t s = e.state._store.take( "s" );
+
+        if ( s.template has_value< stream_t >() ) {
+            stream_t stream = s.template get_value< stream_t >();
+            const auto* r = std::get_if< typename stream_node_t::range >( &stream.node->kind );
+            if ( r == nullptr ) {
+                fold_step( e, f, std::move( x ) );
+                pull( e, stream );
+                return;
+            }
+            int_t from = r->from;
+            e.state.push_value( std::move( x ) );
+            fold_loop( e, f, [ from ]( std::size_t i ){ return object_t( int_t( from + i ) ); }
+                     , 0, r->to > r->from ? r->to - r->from : 0 );
+        } else if ( s.template has_value< int_array_t >() ) {
+            int_array_t a = s.template get_value< int_array_t >();
+            e.state.push_value( std::move( x ) );
+            fold_loop( e, f, [ a ]( std::size_t i ){ return object_t( int_t( a[ i ] ) ); }, 0, a.size() );
+        } else if ( s.template has_value< float_array_t >() ) {
+            float_array_t a = s.template get_value< float_array_t >();
+            e.state.push_value( std::move( x ) );
+            fold_loop( e, f, [ a ]( std::size_t i ){ return object_t( a[ i ] ); }, 0, a.size() );
+        } else {
+            throw std::runtime_error( "expected a Stream or an array but got "s + s.to_string() );
+        }
+    }
+
+    /** iterate f x n, applies f n times to x. **/
+    static void l_iterate( eval_t& e )
+    {
+        int_t n = int_arg( e, "n" );
+        if ( n < 0 )
+            throw std::runtime_error( "negative number of iterations" );
+        e.state.push_value( e.state._store.take( "x" ) );
+        e.loop( arg< fun_obj_t >( e, "f" ), [ n ]( eval_t& e, frame_t& frame ) mutable {
+            if ( n-- == 0 )
+                return false;
+            e.call_in_frame( frame, e.state.pop_value() );
+            return true;
+        } );
+    }
+
+    /** Maps an array in a native loop, the results of f have to fit the
+     *  array. **/
+    template < typename array_t >
+    static void map_loop( eval_t& e, fun_obj_t f, array_t a )
+    {
+        using element_t = std::remove_const_t< std::remove_reference_t< decltype( a[ 0 ] ) > >;
+        std::vector< element_t > out;
+        out.reserve( a.size() );
+        e.loop( std::move( f ), [ a, out, i = std::size_t( 0 ) ]( eval_t& e, frame_t& frame ) mutable {
+            if ( i > 0 ) {
+                object_t y = e.state.pop_value();
+                if ( ! y.template has_value< element_t >() )
+                    throw std::runtime_error( "the result "s + y.to_string() + " does not fit the array" );
+                out.push_back( y.template get_value< element_t >() );
+            }
+            if ( i == a.size() ) {
+                e.state.push_value( object_t( array_t( std::move( out ) ) ) );
+                return false;
+            }
+            e.call_in_frame( frame, object_t( a[ i++ ] ) );
+            return true;
+        } );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Parallel
+    ///////////////////////////////////////////////////////////////////////////
+
+    /** The elements of a range Stream as an Array, arrays as they are. **/
+    static object_t sequence( object_t s )
+    {
+        if ( s.template has_value< stream_t >() ) {
+            stream_t stream = s.template get_value< stream_t >();
+            const auto* r = std::get_if< typename stream_node_t::range >( &stream.node->kind );
+            if ( r == nullptr )
+                throw std::runtime_error( "expected a range but got "s + s.to_string() );
+            std::vector< std::int64_t > values;
+            for ( int_t i = r->from; i < r->to; i++ )
+                values.push_back( i );
+            return object_t( int_array_t( std::move( values ) ) );
+        }
+        if ( ! s.template has_value< int_array_t >() && ! s.template has_value< float_array_t >() )
+            throw std::runtime_error( "expected a range or an array but got "s + s.to_string() );
+        return s;
+    }
+
+    static std::size_t grain_arg( eval_t& e )
+    {
+        int_t grain = int_arg( e, "grain" );
+        if ( grain <= 0 )
+            throw std::runtime_error( "the grain size has to be positive" );
+        return grain;
+    }
+
+    /** Splits the array into chunks of the grain size, runs body( task,
+     *  chunk ) for each as a task and returns their results in the order of
+     *  the chunks, so the outcome does not depend on the scheduling. **/
+    template < typename array_t, typename body_t >
+    static std::vector< object_t > chunked( eval_t& e, const array_t& a, std::size_t grain, body_t body )
+    {
+        std::vector< std::shared_ptr< task_result< object_t > > > tasks;
+        for ( std::size_t from = 0; from < a.size(); from += grain ) {
+            array_t chunk = a.slice( from, std::min( a.size(), from + grain ) );
+            tasks.push_back( e.run_task( [ body, chunk ]( eval_t& task ){ body( task, chunk ); } ) );
+        }
+        std::vector< object_t > results;
+        for ( const auto& t : tasks ) {
+            e.wait( *t );
+            if ( t->escaped )
+                throw std::runtime_error( "the result of a chunk refers to its closures" );
+            results.push_back( std::move( t->value ) );
+        }
+        return results;
+    }
+
+    template < typename array_t >
+    static void p_map_array( eval_t& e, fun_obj_t f, const array_t& a, std::size_t grain )
+    {
+        auto parts = chunked( e, a, grain, [ f ]( eval_t& task, const array_t& chunk ) {
+            map_loop( task, f, chunk );
+        } );
+        std::vector< std::remove_const_t< std::remove_reference_t< decltype( a[ 0 ] ) > > > out;
+        out.reserve( a.size() );
+        for ( const object_t& part : parts ) {
+            const array_t& p = part.template get_value< array_t >();
+            out.insert( out.end(), p.data(), p.data() + p.size() );
+        }
+        e.state.push_value( object_t( array_t( std::move( out ) ) ) );
+    }
+
+    /** pmap f s grain, maps a range or an array by chunks of grain elements
+     *  on the task pool, sequentially without one. **/
+    static void p_map( eval_t& e )
+    {
+        fun_obj_t f = arg< fun_obj_t >( e, "f" );
+        std::size_t grain = grain_arg( e );
+        object_t s = sequence( e.state._store.take( "s" ) );
+        if ( s.template has_value< int_array_t >() )
+            p_map_array( e, std::move( f ), s.template get_value< int_array_t >(), grain );
+        else
+            p_map_array( e, std::move( f ), s.template get_value< float_array_t >(), grain );
+    }
+
+    template < typename array_t >
+    static void p_reduce_array( eval_t& e, fun_obj_t f, object_t x, const array_t& a, std::size_t grain )
+    {
+        auto parts = chunked( e, a, grain, [ f, x ]( eval_t& task, const array_t& chunk ) {
+            task.state.push_value( x );
+            fold_loop( task, f, [ chunk ]( std::size_t i ){ return object_t( chunk[ i ] ); }, 0, chunk.size() );
+        } );
+        e.state.push_value( std::move( x ) );
+        fold_loop( e, std::move( f ), [ parts = std::move( parts ) ]( std::size_t i ){ return parts[ i ]; }
+                 , 0, parts.size() );
+    }
+
+    /** preduce f x s grain, folds every chunk of grain elements from x on
+     *  the task pool, then folds the results of the chunks in their order.
+     *  f has to be associative with x as its identity. **/
+    static void p_reduce( eval_t& e )
+    {
+        fun_obj_t f = arg< fun_obj_t >( e, "f" );
+        std::size_t grain = grain_arg( e );
+        object_t x = e.state._store.take( "x" );
+        object_t s = sequence( e.state._store.take( "s" ) );
+        if ( s.template has_value< int_array_t >() )
+            p_reduce_array( e, std::move( f ), std::move( x ), s.template get_value< int_array_t >(), grain );
+        else
+            p_reduce_array( e, std::move( f ), std::move( x ), s.template get_value< float_array_t >(), grain );
+    }
+
+    /** A list of < Worker i executed stolen > with the tasks run and stolen
+     *  by each thread of the pool, the 0th are those of other threads. **/
+    static void p_stats( eval_t& e )
+    {
+        object_t result = nil();
+        if ( e.pool )
+            for ( int i = e.pool->queues.size() - 1; i >= 0; i-- ) {
+                const auto& q = *e.pool->queues[ i ];
+                result = cons( object_t( "Worker", attrs_t{ object_t( int_t( i ) )
+                                                          , object_t( int_t( q.executed ) )
+                                                          , object_t( int_t( q.stolen ) ) } )
+                             , std::move( result ) );
+            }
+        e.state.push_value( std::move( result ) );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Futures
+    ///////////////////////////////////////////////////////////////////////////
+
+    using future_t = typename eval_t::types::future_t;
+
+    /** The argument is passed as a thunk. **/
+    static object_t lazy_unary( evaluable_t e )
+    {
+        function_path< evaluable_t > path( { variable_pattern( "x" ) }, variable_pattern( "_" ), e );
+        function_object< evaluable_t > fun( { std::move( path ) }, 1 );
+        fun.lazy_args = { true };
+        return object_t( std::move( fun ) );
+    }
+
+    /** spawn x, evaluates x as a task on the pool, right away without one,
+     *  and returns its Future. **/
+    static void fut_spawn( eval_t& e )
+    {
+        using thunk_t = typename eval_t::types::thunk_t;
+        thunk_t x = e.state._store.lookup( "x" ).template get_value< thunk_t >();
+        auto result = e.run_task( [ x ]( eval_t& task ){ task.force( x ); } );
+        e.state.push_value( object_t( future_t{ std::move( result ) } ) );
+    }
+
+    /** await f, the value of the future. A task of the pool parks while
+     *  the future is pending, see eval::retry. **/
+    static void fut_await( eval_t& e )
+    {
+        future_t f = arg< future_t >( e, "f" );
+        e.retry( f.result->completed, [ f ]( eval_t& e ) {
+            if ( ! f.result->done.load( std::memory_order_acquire ) )
+                return false;
+            if ( f.result->error )
+                std::rethrow_exception( f.result->error );
+            e.state.push_value( e.adopt( *f.result ) );
+            return true;
+        } );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Channels
+    ///////////////////////////////////////////////////////////////////////////
+
+    using channel_t = typename eval_t::types::channel_t;
+
+    /** channel t n, a channel of capacity n for values of the type named t,
+     *  of any type if t is empty. **/
+    static void c_make( eval_t& e )
+    {
+        int_t n = int_arg( e, "n" );
+        if ( n <= 0 )
+            throw std::runtime_error( "the capacity of a channel has to be positive" );
+        e.state.push_value( object_t( channel_t{ std::make_shared< mpmc_queue< object_t > >( n )
+                                               , arg< text >( e, "t" ).str() } ) );
+    }
+
+    /** send c x, waits while the channel is full and returns the channel.
+     *  The value is moved to the receiver, it must not hold closures, as
+     *  they refer to the store of the sender. **/
+    static void c_send( eval_t& e )
+    {
+        channel_t c = arg< channel_t >( e, "c" );
+        object_t x = e.state._store.take( "x" );
+        if ( ! c.element_type.empty() && x.name != c.element_type )
+            throw std::runtime_error( "expected a "s + c.element_type + " but got " + x.to_string() );
+        if ( eval_t::holds_closures( x ) )
+            throw std::runtime_error( "cannot send "s + x.to_string() + ", which holds closures" );
+        e.retry( *c.waiters, [ c, x ]( eval_t& e ) mutable {
+            if ( ! c.queue->try_push( x ) )
+                return false;
+            c.waiters->notify();
+            e.state.push_value( object_t( c ) );
+            return true;
+        } );
+    }
+
+    /** recv c, waits for a value, see eval::retry. **/
+    static void c_recv( eval_t& e )
+    {
+        channel_t c = arg< channel_t >( e, "c" );
+        e.retry( *c.waiters, [ c ]( eval_t& e ) {
+            object_t x;
+            if ( ! c.queue->try_pop( x ) )
+                return false;
+            c.waiters->notify();
+            e.state.push_value( std::move( x ) );
+            return true;
+        } );
+    }
+
+    /** try_recv c, Some value or None if the channel is empty. **/
+    static void c_try_recv( eval_t& e )
+    {
+        channel_t c = arg< channel_t >( e, "c" );
+        object_t x;
+        if ( ! c.queue->try_pop( x ) ) {
+            e.state.push_value( object_t( "None", attrs_t{} ) );
+            return;
+        }
+        c.waiters->notify();
+        e.state.push_value( object_t( "Some", attrs_t{ std::move( x ) } ) );
+    }
+
+    /** actor f x, evaluates f x by an evaluator on a thread of its own and
+     *  returns the Future of its value. Actors talk through channels. **/
+    static void c_actor( eval_t& e )
+    {
+        fun_obj_t f = arg< fun_obj_t >( e, "f" );
+        object_t x = e.state._store.take( "x" );
+        auto result = e.run_thread( [ f, x ]( eval_t& actor ){ actor.call( f, { x } ); } );
+        e.state.push_value( object_t( future_t{ std::move( result ) } ) );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Strings
+    ///////////////////////////////////////////////////////////////////////////
+
+    static void t_length( eval_t& e )
+    {
+        e.state.push_value( object_t( int_t( arg< text >( e, "s" ).size() ) ) );
+    }
+
+    static void t_concat( eval_t& e )
+    {
+        e.state.push_value( object_t( text::concat( arg< text >( e, "a" ), arg< text >( e, "b" ) ) ) );
+    }
+
+    static void t_slice( eval_t& e )
+    {
+        text s = arg< text >( e, "s" );
+        size_t to = array_index( e, "j", s.size() );
+        size_t from = array_index( e, "i", to );
+        e.state.push_value( object_t( s.slice( from, to ) ) );
+    }
+
+    /** Character code of the i-th byte. **/
+    static void t_char( eval_t& e )
+    {
+        text s = arg< text >( e, "s" );
+        if ( s.size() == 0 )
+            throw std::runtime_error( "index to an empty string" );
+        e.state.push_value( object_t( int_t( ( unsigned char ) s.at( array_index( e, "i", s.size() - 1 ) ) ) ) );
+    }
+
+    /** -1, 0 or 1 as the first string is before, equal to or after the
+     *  second one. **/
+    static void t_compare( eval_t& e )
+    {
+        int c = text::compare( arg< text >( e, "a" ), arg< text >( e, "b" ) );
+        e.state.push_value( object_t( int_t( ( c > 0 ) - ( c < 0 ) ) ) );
+    }
+
+    static void t_hash( eval_t& e )
+    {
+        e.state.push_value( object_t( int_t( arg< text >( e, "s" ).hash() >> 1 ) ) );
+    }
+
+    static void t_show( eval_t& e )
+    {
+        object_t a = e.state._store.lookup( "a" );
+        std::string shown;
+        if ( a.template has_value< int_t >() )
+            shown = std::to_string( a.template get_value< int_t >() );
+        else if ( a.template has_value< bigint >() )
+            shown = a.template get_value< bigint >().to_string();
+        else if ( a.template has_value< double >() ) {
+            std::ostringstream os;
+            os << a.template get_value< double >();
+            shown = os.str();
+        } else if ( a.template has_value< text >() ) {
+            e.state.push_value( std::move( a ) );
+            return;
+        } else
+            shown = a.to_string();
+        e.state.push_value( object_t( text( shown ) ) );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Maps
+    ///////////////////////////////////////////////////////////////////////////
+
+    using map_t = typename eval_t::types::map_t;
+
+    static void m_insert( eval_t& e )
+    {
+        e.state.push_value( object_t( arg< map_t >( e, "m" ).insert( e.state._store.take( "k" )
+                                                                   , e.state._store.take( "v" ) ) ) );
+    }
+
+    /** < Some v > if the key is present, < None > otherwise. **/
+    static void m_lookup( eval_t& e )
+    {
+        const map_t m = arg< map_t >( e, "m" );
+        const object_t* v = m.find( e.state._store.lookup( "k" ) );
+        e.state.push_value( v ? object_t( "Some", attrs_t{ *v } ) : object_t( "None", attrs_t{} ) );
+    }
+
+    static void m_remove( eval_t& e )
+    {
+        e.state.push_value( object_t( arg< map_t >( e, "m" ).remove( e.state._store.lookup( "k" ) ) ) );
+    }
+
+    static void m_size( eval_t& e )
+    {
+        e.state.push_value( object_t( int_t( arg< map_t >( e, "m" ).size() ) ) );
+    }
+
+    using entries_t = std::shared_ptr< std::vector< std::pair< object_t, object_t > > >;
+
+    static void m_fold_step( eval_t& e, fun_obj_t fun, entries_t entries, size_t i )
+    {
+        if ( i == entries->size() )
+            return;
+        e.push_native( [ fun, entries, i ]( eval_t& e ) {
+            m_fold_step( e, fun, entries, i + 1 );
+        } );
+        const auto& [ k, v ] = ( *entries )[ i ];
+        e.call( fun, { e.state.pop_value(), k, v } );
+    }
+
+    /** Calls f acc k v for every entry, in an unspecified order. **/
+    static void m_fold( eval_t& e )
+    {
+        auto entries = std::make_shared< std::vector< std::pair< object_t, object_t > > >();
+        arg< map_t >( e, "m" ).for_each( [&]( const object_t& k, const object_t& v ) {
+            entries->emplace_back( k, v );
+        } );
+        e.state.push_value( e.state._store.lookup( "x" ) );
+        m_fold_step( e, arg< fun_obj_t >( e, "f" ), entries, 0 );
+    }
 
     static const inline std::map< std::string, std::pair< builtin_t, builtin_wrapper > > bindings {
         { "__int_add__",  { add,        wrapper_int_binary } },
@@ -75,16 +1219,90 @@ struct builtins
         { "__int_mul__",  { mul,        wrapper_int_binary } },
         { "__int_div__",  { div,        wrapper_int_binary } },
         { "__int_mod__",  { mod,        wrapper_int_binary } },
-        { "__bool_and__", { mod,        wrapper_int_binary } },
-        { "__bool_or__",  { mod,        wrapper_int_binary } },
+        { "__bool_and__", { b_and, bool_lazy_o } },
+        { "__bool_or__",  { b_or,  bool_lazy_o } },
         { "__trace__",    { trace,      wrapper_any_unary  } },
-        { "+",            { add,        wrapper_int_binary } },
-        { "-",            { sub,        wrapper_int_binary } },
-        { "*",            { mul,        wrapper_int_binary } },
-        { "/",            { div,        wrapper_int_binary } },
-        { "%",            { mod,        wrapper_int_binary } },
-        { "&&",           { b_and,      bool_binary_o } },
-        { "||",           { b_or,       bool_binary_o } },
+        { "+",            { add,        wrapper_num_binary } },
+        { "-",            { sub,        wrapper_num_binary } },
+        { "*",            { mul,        wrapper_num_binary } },
+        { "/",            { div,        wrapper_num_binary } },
+        { "%",            { mod,        wrapper_num_binary } },
+        { "float",        { to_float, signature( { typed( "Int", "a" ) } ) } },
+        { "truncate",     { truncate, signature( { typed( "Float", "a" ) } ) } },
+        { "sqrt",         { f_sqrt,   signature( { typed( "Float", "a" ) } ) } },
+        { "exp",          { f_exp,    signature( { typed( "Float", "a" ) } ) } },
+        { "&&",           { b_and, bool_lazy_o } },
+        { "||",           { b_or,  bool_lazy_o } },
+        { "range",        { s_range,  signature( { typed( "Int", "a" ), typed( "Int", "b" ) } ) } },
+        { "unfold",       { s_unfold, signature( { typed( "Fun", "f" ), variable_pattern( "x" ) } ) } },
+        { "map",          { s_map,    signature( { typed( "Fun", "f" ), variable_pattern( "s" ) } ) } },
+        { "filter",       { s_filter, signature( { typed( "Fun", "f" ), typed( "Stream", "s" ) } ) } },
+        { "take",         { s_take,   signature( { typed( "Int", "n" ), typed( "Stream", "s" ) } ) } },
+        { "fold",         { l_foldl,  signature( { typed( "Fun", "f" ), variable_pattern( "x" )
+                                                 , variable_pattern( "s" ) } ) } },
+        { "foldl",        { l_foldl,  signature( { typed( "Fun", "f" ), variable_pattern( "x" )
+                                                 , variable_pattern( "s" ) } ) } },
+        { "iterate",      { l_iterate, signature( { typed( "Fun", "f" ), variable_pattern( "x" )
+                                                  , typed( "Int", "n" ) } ) } },
+        { "pmap",         { p_map,    signature( { typed( "Fun", "f" ), variable_pattern( "s" )
+                                                 , typed( "Int", "grain" ) } ) } },
+        { "preduce",      { p_reduce, signature( { typed( "Fun", "f" ), variable_pattern( "x" )
+                                                 , variable_pattern( "s" ), typed( "Int", "grain" ) } ) } },
+        { "spawn",        { fut_spawn,  lazy_unary } },
+        { "await",        { fut_await,  signature( { typed( "Future", "f" ) } ) } },
+        { "channel",      { c_make,   signature( { typed( "String", "t" ), typed( "Int", "n" ) } ) } },
+        { "send",         { c_send,   signature( { typed( "Channel", "c" ), variable_pattern( "x" ) } ) } },
+        { "recv",         { c_recv,   signature( { typed( "Channel", "c" ) } ) } },
+        { "try_recv",     { c_try_recv, signature( { typed( "Channel", "c" ) } ) } },
+        { "actor",        { c_actor,  signature( { typed( "Fun", "f" ), variable_pattern( "x" ) } ) } },
+        { "pool_stats",   { p_stats,  signature( { variable_pattern( "_" ) } ) } },
+        { "uncons",       { s_uncons, signature( { typed( "Stream", "s" ) } ) } },
+        { "Cons",         { b_cons,   signature( { variable_pattern( "a" ), variable_pattern( "b" ) } ) } },
+        { "array_make",   { a_make,   signature( { typed( "Int", "n" ), typed( "Int", "x" ) } ) } },
+        { "array_range",  { a_range,  signature( { typed( "Int", "a" ), typed( "Int", "b" ) } ) } },
+        { "array_from",   { a_from,   signature( { typed( "Stream", "s" ) } ) } },
+        { "array_length", { a_length, signature( { typed( "Array", "a" ) } ) } },
+        { "array_set",    { a_set,    signature( { typed( "Array", "a" ), typed( "Int", "i" ), typed( "Int", "x" ) } ) } },
+        { "array_get",    { a_get,    signature( { typed( "Array", "a" ), typed( "Int", "i" ) } ) } },
+        { "array_slice",  { a_slice,  signature( { typed( "Array", "a" ), typed( "Int", "i" )
+                                                 , typed( "Int", "j" ) } ) } },
+        { "array_map",    { a_map,    signature( { typed( "Fun", "f" ), typed( "Array", "a" )
+                                                 , typed( "Int", "k" ) } ) } },
+        { "array_zip",    { a_zip,    signature( { typed( "Fun", "f" ), typed( "Array", "a" )
+                                                 , typed( "Array", "b" ) } ) } },
+        { "array_sum",    { a_sum,    signature( { typed( "Array", "a" ) } ) } },
+        { "array_min",    { a_min,    signature( { typed( "Array", "a" ) } ) } },
+        { "array_max",    { a_max,    signature( { typed( "Array", "a" ) } ) } },
+        { "array_dot",    { a_dot,    signature( { typed( "Array", "a" ), typed( "Array", "b" ) } ) } },
+        { "array_scan",   { a_scan,   signature( { typed( "Array", "a" ) } ) } },
+        { "farray_make",   { f_make,   signature( { typed( "Int", "n" ), typed( "Float", "x" ) } ) } },
+        { "farray_of",     { f_of,     signature( { typed( "Array", "a" ) } ) } },
+        { "farray_length", { f_length, signature( { typed( "FloatArray", "a" ) } ) } },
+        { "farray_get",    { f_get,    signature( { typed( "FloatArray", "a" ), typed( "Int", "i" ) } ) } },
+        { "farray_map",    { f_map,    signature( { typed( "Fun", "f" ), typed( "FloatArray", "a" )
+                                                  , variable_pattern( "k" ) } ) } },
+        { "farray_zip",    { f_zip,    signature( { typed( "Fun", "f" ), typed( "FloatArray", "a" )
+                                                  , typed( "FloatArray", "b" ) } ) } },
+        { "farray_sum",    { f_sum,    signature( { typed( "FloatArray", "a" ) } ) } },
+        { "farray_dot",    { f_dot,    signature( { typed( "FloatArray", "a" ), typed( "FloatArray", "b" ) } ) } },
+        { "farray_sqrt",   { f_sqrt_all, signature( { typed( "FloatArray", "a" ) } ) } },
+        { "farray_exp",    { f_exp_all,  signature( { typed( "FloatArray", "a" ) } ) } },
+        { "string_length",  { t_length,  signature( { typed( "String", "s" ) } ) } },
+        { "string_concat",  { t_concat,  signature( { typed( "String", "a" ), typed( "String", "b" ) } ) } },
+        { "++",             { t_concat,  signature( { typed( "String", "a" ), typed( "String", "b" ) } ) } },
+        { "string_slice",   { t_slice,   signature( { typed( "String", "s" ), typed( "Int", "i" )
+                                                    , typed( "Int", "j" ) } ) } },
+        { "string_char",    { t_char,    signature( { typed( "String", "s" ), typed( "Int", "i" ) } ) } },
+        { "string_compare", { t_compare, signature( { typed( "String", "a" ), typed( "String", "b" ) } ) } },
+        { "string_hash",    { t_hash,    signature( { typed( "String", "s" ) } ) } },
+        { "show",           { t_show,    signature( { variable_pattern( "a" ) } ) } },
+        { "map_insert",   { m_insert, signature( { typed( "Map", "m" ), variable_pattern( "k" )
+                                                 , variable_pattern( "v" ) } ) } },
+        { "map_lookup",   { m_lookup, signature( { typed( "Map", "m" ), variable_pattern( "k" ) } ) } },
+        { "map_remove",   { m_remove, signature( { typed( "Map", "m" ), variable_pattern( "k" ) } ) } },
+        { "map_size",     { m_size,   signature( { typed( "Map", "m" ) } ) } },
+        { "map_fold",     { m_fold,   signature( { typed( "Fun", "f" ), variable_pattern( "x" )
+                                                 , typed( "Map", "m" ) } ) } },
     };
 
     static void add_builtins( eval_t& e )
@@ -92,5 +1310,16 @@ struct builtins
         for ( const auto& [ k, v ] : bindings ) {
             e.state._store.bind( k, v.second( v.first ) );
         }
+        e.state._store.bind( "Nil", nil() );
+        e.state._store.bind( "map_empty", object_t( map_t() ) );
+    }
+
+    /** The same bindings as globals of a program, see program_image. **/
+    static void add_builtins( program_image< object_t >& p )
+    {
+        for ( const auto& [ k, v ] : bindings )
+            p.add_global( k, v.second( v.first ) );
+        p.add_global( "Nil", nil() );
+        p.add_global( "map_empty", object_t( map_t() ) );
     }
 };
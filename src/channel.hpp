@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/** Waiters parked until something changes, a channel gets a value or room
+ *  for one, a task finishes. Every notify bumps the epoch and calls the
+ *  waiters added so far once. A waiter, which missed a notify since the
+ *  epoch it has seen, is called right away, so no change is lost. **/
+struct wait_list
+{
+    using waiter_t = std::function< void() >;
+
+    std::size_t epoch() const { return _epoch.load(); }
+
+    void add( waiter_t waiter, std::size_t seen )
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            waiters.push_back( std::move( waiter ) );
+            count++;
+            // either this sees the epoch of a notify or the notify sees the count
+            if ( _epoch.load() == seen )
+                return;
+            waiter = std::move( waiters.back() );
+            waiters.pop_back();
+            count--;
+        }
+        waiter();
+    }
+
+    void notify()
+    {
+        _epoch++;
+        if ( count.load() == 0 )
+            return;
+        std::vector< waiter_t > woken;
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            woken.swap( waiters );
+            count = 0;
+        }
+        for ( auto& w : woken )
+            w();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector< waiter_t > waiters;
+    std::atomic< std::size_t > _epoch{ 0 };
+    std::atomic< int > count{ 0 };
+};
+
+/** Bounded lock-free multi-producer multi-consumer queue after D. Vyukov.
+ *  Every cell has a sequence number, which tells whether the cell is free
+ *  for the producer at a position or filled for the consumer at it, so
+ *  producers and consumers claim positions by a single compare and swap. **/
+template < typename T >
+struct mpmc_queue
+{
+    struct cell_t
+    {
+        std::atomic< std::size_t > sequence;
+        T value;
+    };
+
+    explicit mpmc_queue( std::size_t capacity )
+        : cells( new cell_t[ capacity ] )
+        , size( capacity )
+    {
+        for ( std::size_t i = 0; i < capacity; i++ )
+            cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    mpmc_queue( const mpmc_queue& ) = delete;
+    mpmc_queue& operator =( const mpmc_queue& ) = delete;
+
+    std::size_t capacity() const { return size; }
+
+    /** Moves the value in, false if the queue is full. **/
+    bool try_push( T& value )
+    {
+        std::size_t pos = tail.load( std::memory_order_relaxed );
+        while ( true ) {
+            cell_t& cell = cells[ pos % size ];
+            std::size_t sequence = cell.sequence.load( std::memory_order_acquire );
+            if ( sequence == pos ) {
+                if ( tail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                    cell.value = std::move( value );
+                    cell.sequence.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            } else if ( sequence < pos ) {
+                return false;
+            } else {
+                pos = tail.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    /** Moves the oldest value out, false if the queue is empty. **/
+    bool try_pop( T& value )
+    {
+        std::size_t pos = head.load( std::memory_order_relaxed );
+        while ( true ) {
+            cell_t& cell = cells[ pos % size ];
+            std::size_t sequence = cell.sequence.load( std::memory_order_acquire );
+            if ( sequence == pos + 1 ) {
+                if ( head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                    value = std::move( cell.value );
+                    cell.value = T();
+                    cell.sequence.store( pos + size, std::memory_order_release );
+                    return true;
+                }
+            } else if ( sequence < pos + 1 ) {
+                return false;
+            } else {
+                pos = head.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+private:
+    std::unique_ptr< cell_t[] > cells;
+    std::size_t size;
+
+    // producers and consumers do not share a cache line
+    alignas( 64 ) std::atomic< std::size_t > tail{ 0 };
+    alignas( 64 ) std::atomic< std::size_t > head{ 0 };
+};
+
+/** A channel value, a handle of a queue shared by the evaluators, which
+ *  accepts values of the element type only, any values if it is empty.
+ *  Whoever pushes or pops a value notifies the waiters. **/
+template < typename T >
+struct channel
+{
+    std::shared_ptr< mpmc_queue< T > > queue;
+    std::string element_type;
+    // receivers waiting for a value and senders waiting for room
+    std::shared_ptr< wait_list > waiters = std::make_shared< wait_list >();
+
+    bool operator ==( const channel &o ) const { return queue == o.queue; }
+
+    std::size_t hash() const { return std::hash< const void* >()( queue.get() ); }
+
+    friend std::ostream& operator <<( std::ostream& os, const channel& c )
+    {
+        os << c.queue->capacity();
+        if ( ! c.element_type.empty() )
+            os << " " << c.element_type;
+        return os;
+    }
+};
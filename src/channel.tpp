@@ -0,0 +1,68 @@
+#include <cassert>
+#include <thread>
+#include <vector>
+
+#include "channel.hpp"
+
+void test_bounded()
+{
+    mpmc_queue< int > q( 3 );
+    int x;
+    assert( ! q.try_pop( x ) );
+    for ( int i = 0; i < 3; i++ ) {
+        x = i;
+        assert( q.try_push( x ) );
+    }
+    x = 3;
+    assert( ! q.try_push( x ) );
+
+    // wraps around the cells
+    for ( int round = 0; round < 10; round++ ) {
+        assert( q.try_pop( x ) && x == round );
+        x = round + 3;
+        assert( q.try_push( x ) );
+    }
+}
+
+void test_producers_consumers()
+{
+    const int producers = 3, consumers = 3, count = 20000;
+    mpmc_queue< long > q( 64 );
+    std::vector< long > sums( consumers, 0 );
+    std::atomic< int > received{ 0 };
+
+    std::vector< std::thread > threads;
+    for ( int p = 0; p < producers; p++ )
+        threads.emplace_back( [ & ]{
+            for ( long i = 1; i <= count; i++ ) {
+                long v = i;
+                while ( ! q.try_push( v ) )
+                    std::this_thread::yield();
+            }
+        } );
+    for ( int c = 0; c < consumers; c++ )
+        threads.emplace_back( [ &, c ]{
+            long v;
+            while ( received < producers * count ) {
+                if ( q.try_pop( v ) ) {
+                    sums[ c ] += v;
+                    received++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        } );
+    for ( auto& t : threads )
+        t.join();
+
+    long total = 0;
+    for ( long s : sums )
+        total += s;
+    assert( total == producers * ( long( count ) * ( count + 1 ) / 2 ) );
+}
+
+int main()
+{
+    test_bounded();
+    test_producers_consumers();
+}
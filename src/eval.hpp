@@ -1,6 +1,12 @@
+#pragma once
+
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <functional>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <map>
 #include <stack>
@@ -11,6 +17,12 @@
 #include "types.hpp"
 #include "values.hpp"
 #include "scopestack.hpp"
+#include "stream.hpp"
+#include "array.hpp"
+#include "hamt.hpp"
+#include "text.hpp"
+#include "pool.hpp"
+#include "channel.hpp"
 #include "ast.hpp"
 
 using namespace std::literals::string_literals;
@@ -34,18 +46,49 @@ struct literal
     }
 };
 
+/** Overwrites the thunk in the slot with its value, so that it is
+ *  evaluated at most once. **/
+template < typename eval_t >
+struct thunk_update
+{
+    using store_id = typename eval_t::eval_state_t::store_t::store_id;
+
+    store_id slot;
+
+    thunk_update( store_id slot ) : slot( slot ) {};
+
+    void visit( eval_t& eval ) {
+        eval.state._store.at( slot ) = eval.state._values.top();
+    }
+};
+
 template < typename eval_t >
 struct variable
 {
     using object_t = typename eval_t::object_t;
+    using thunk_t  = typename eval_t::types::thunk_t;
 
     identifier_t id;
+    bool last_use = false;
 
-    variable( identifier_t id ) : id( id ) {};
+    variable( identifier_t id, bool last_use = false )
+        : id( id )
+        , last_use( last_use ) {};
 
     void visit( eval_t& eval ) {
-        object_t value = eval.state._store.lookup( id );
-        eval.state.push_value( std::move( value ) );
+        auto& store = eval.state._store;
+        auto slot = store.lookup_id( id );
+        const object_t& value = store.get( slot );
+        if ( value.template has_value< thunk_t >() ) {
+            eval.state.push_cell( thunk_update< eval_t >( slot ) );
+            eval.force( value.template get_value< thunk_t >() );
+            return;
+        }
+        // slots below captured_until may be read again by a closure
+        if ( last_use && slot >= store.captured_until && slot >= store.globals_end )
+            eval.state.push_value( std::move( store.at( slot ) ) );
+        else
+            eval.state.push_value( value );
     }
 
     friend std::ostream& operator<<( std::ostream& os, variable v )
@@ -55,6 +98,83 @@ struct variable
 };
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Tasks
+///////////////////////////////////////////////////////////////////////////////
+
+/** Result of an expression evaluated on the task pool, see eval::fork. **/
+template < typename object_t >
+struct task_result
+{
+    std::atomic< bool > done{ false };
+    // notified once the task is done
+    wait_list completed;
+    object_t value;
+    std::exception_ptr error;
+    // the value holds closures, which may refer to the slots of the task
+    // from prefix on, see eval::adopt
+    bool escaped = false;
+    int prefix = 0;
+    std::vector< object_t > slots;
+};
+
+/** Threads of the actors of an evaluation, see the actor builtin. The
+ *  evaluator, which started the evaluation, stops them when it goes away:
+ *  an actor waiting for a value gives up, see eval::block_until, and the
+ *  threads are joined. **/
+struct actor_threads
+{
+    std::atomic< bool > stopping{ false };
+
+    void start( std::function< void() > job )
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        if ( stopping )
+            throw std::runtime_error( "cannot start an actor, the evaluation is over" );
+        threads.emplace_back( std::move( job ) );
+    }
+
+    void stop()
+    {
+        stopping = true;
+        std::vector< std::thread > running;
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            running.swap( threads );
+        }
+        for ( auto& t : running )
+            t.join();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector< std::thread > threads;
+};
+
+/** Waits for the task and pushes its value, see eval::adopt. A task of the
+ *  pool parks while it waits, see eval::retry. **/
+template < typename eval_t >
+struct task_join
+{
+    using object_t = typename eval_t::object_t;
+
+    std::shared_ptr< task_result< object_t > > task;
+
+    task_join( std::shared_ptr< task_result< object_t > > task )
+        : task( std::move( task ) ) {}
+
+    void visit( eval_t& eval ) {
+        eval.retry( task->completed, [ task = task ]( eval_t& e ) {
+            if ( ! task->done.load( std::memory_order_acquire ) )
+                return false;
+            if ( task->error )
+                std::rethrow_exception( task->error );
+            e.state.push_value( e.adopt( *task ) );
+            return true;
+        } );
+    }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Functions
 ///////////////////////////////////////////////////////////////////////////////
@@ -72,7 +192,7 @@ struct fun_cleanup
     void visit( eval_t& eval )
     {
         // TODO: check output pattern
-        eval.state._store.scopes.pop_scope();
+        eval.state._store.pop_scope();
     }
 
     friend std::ostream& operator<<( std::ostream& os, fun_cleanup f )
@@ -103,15 +223,19 @@ struct fun_call
         for ( int i = 0; i < arity; i++ )
             values.push_back( eval.state.pop_value() );
 
-        auto result = match( fun, values );
+        auto result = match( fun, values, eval.adaptive_dispatch );
         if ( result.isleft() )
             throw std::runtime_error( "no pattern match: "s + result.left() );
-        const auto &[ matching, evaluable ] = result.right();
+
+        /** The arguments are moved to the store, so that a builtin sees the
+         *  only reference to a value, which is not used after the call. **/
+        values.clear();
+        auto [ matching, evaluable ] = std::move( std::get< 1 >( result.v ) );
 
         eval.state.push_cell( fun_cleanup< eval_t >( std::move( fun ) ) );
-        eval.state._store.scopes.add_scope();
-        eval.state._store.bind( matching );
-        eval.evaluate( evaluable );
+        eval.state._store.add_scope();
+        eval.state._store.bind( std::move( matching ) );
+        eval.evaluate( std::move( evaluable ) );
     }
 
     friend std::ostream& operator<<( std::ostream& os, fun_call f )
@@ -150,9 +274,18 @@ struct fun_args
             eval.state.push_cell( fun_args< eval_t >( {} ) );
         }
 
+        // empty unless the function has lazy parameters
+        std::vector< bool > lazy = fun.lazy_args;
+        std::vector< bool > forked = eval.forked_arguments( args, arity, lazy );
+
         eval.state.push_cell( fun_call< eval_t >( std::move( fun ), arity ) );
         for ( int i = 0; i < arity; i ++ ) {
-            eval.push( args.back() );
+            if ( i < lazy.size() && lazy[ i ] )
+                eval.state.push_cell( literal< eval_t >( eval.translator.make_thunk( args.back(), eval ) ) );
+            else if ( forked[ i ] )
+                eval.state.push_cell( task_join< eval_t >( eval.fork( args.back() ) ) );
+            else
+                eval.push( args.back() );
             args.pop_back();
         }
 
@@ -202,7 +335,7 @@ template < typename eval_t >
 struct scope_pop
 {
     void visit( eval_t& eval ) {
-        eval.state._store.scopes.pop_scope();
+        eval.state._store.pop_scope();
     }
 };
 
@@ -223,12 +356,99 @@ struct let_in_bind
 
     void visit( eval_t& eval ) {
         object_t value = eval.state.pop_value();
-        eval.state._store.scopes.add_scope();
+        // a definition binds in the current scope
+        bool definition = ! expression.get();
+        if ( ! definition )
+            eval.state._store.add_scope();
 
         const auto& matching = match( pat, value );
         if ( ! matching.has_value() )
             throw std::runtime_error( "variable does not match pattern" );
-        eval.state._store.assign( matching.value() );
+        eval.state._store.bind( matching.value() );
+        if ( definition )
+            return;
+        eval.state.push_cell( scope_pop< eval_t >() );
+        eval.push( expression );
+    }
+};
+
+/** Stores the value to the slot, which was reserved by let_rec_init and
+ *  which may be already captured by closures in the value. **/
+template < typename eval_t >
+struct let_rec_bind
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+    using store_id = typename eval_t::eval_state_t::store_t::store_id;
+
+    store_id slot;
+    ast_node_ptr expression;
+
+    let_rec_bind( store_id slot, ast_node_ptr expression )
+        : slot( slot )
+        , expression( std::move( expression ) ) {}
+
+    void visit( eval_t& eval ) {
+        eval.state._store.at( slot ) = eval.state.pop_value();
+        if ( ! expression.get() )
+            return;
+        eval.state.push_cell( scope_pop< eval_t >() );
+        eval.push( expression );
+    }
+};
+
+template < typename eval_t >
+struct let_rec_init
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+    using object_t = typename eval_t::object_t;
+
+    identifier_t name;
+    ast_node_ptr value;
+    ast_node_ptr expression;
+
+    let_rec_init
+        ( identifier_t name
+        , ast_node_ptr value
+        , ast_node_ptr expression )
+        : name( std::move( name ) )
+        , value( std::move( value ) )
+        , expression( std::move( expression ) ) {}
+
+    void visit( eval_t& eval ) {
+        if ( expression.get() )
+            eval.state._store.add_scope();
+        auto slot = eval.state._store.bind( name, object_t() );
+        eval.state.push_cell( let_rec_bind< eval_t >( slot, std::move( expression ) ) );
+        eval.push( value );
+    }
+};
+
+/** Binds an unevaluated value, it is evaluated on the first lookup. **/
+template < typename eval_t >
+struct let_lazy
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+
+    identifier_t name;
+    ast_node_ptr value;
+    ast_node_ptr expression;
+
+    let_lazy
+        ( identifier_t name
+        , ast_node_ptr value
+        , ast_node_ptr expression )
+        : name( std::move( name ) )
+        , value( std::move( value ) )
+        , expression( std::move( expression ) ) {}
+
+    void visit( eval_t& eval ) {
+        auto thunk = eval.translator.make_thunk( value, eval );
+        if ( ! expression.get() ) {
+            eval.state._store.bind( name, std::move( thunk ) );
+            return;
+        }
+        eval.state._store.add_scope();
+        eval.state._store.bind( name, std::move( thunk ) );
         eval.state.push_cell( scope_pop< eval_t >() );
         eval.push( expression );
     }
@@ -257,6 +477,279 @@ struct let_in_init
     }
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Conditionals
+///////////////////////////////////////////////////////////////////////////////
+
+template < typename eval_t >
+struct if_branch
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+    using object_t = typename eval_t::object_t;
+
+    ast_node_ptr then_branch;
+    ast_node_ptr else_branch;
+
+    if_branch
+        ( ast_node_ptr then_branch
+        , ast_node_ptr else_branch )
+        : then_branch( std::move( then_branch ) )
+        , else_branch( std::move( else_branch ) ) {}
+
+    void visit( eval_t& eval ) {
+        object_t condition = eval.state.pop_value();
+        if ( ! condition.template has_value< bool >() )
+            throw std::runtime_error( "condition is not a Bool: "s + condition.to_string() );
+        eval.push( condition.template get_value< bool >() ? then_branch : else_branch );
+    }
+};
+
+template < typename eval_t >
+struct if_init
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+
+    ast_node_ptr condition;
+    ast_node_ptr then_branch;
+    ast_node_ptr else_branch;
+
+    if_init
+        ( ast_node_ptr condition
+        , ast_node_ptr then_branch
+        , ast_node_ptr else_branch )
+        : condition( std::move( condition ) )
+        , then_branch( std::move( then_branch ) )
+        , else_branch( std::move( else_branch ) ) {}
+
+    void visit( eval_t& eval ) {
+        eval.state.push_cell( if_branch< eval_t >( std::move( then_branch )
+                                                 , std::move( else_branch ) ) );
+        eval.push( condition );
+    }
+};
+
+/** The operands of && and || are Bools, the right one too, when it is
+ *  the result. **/
+template < typename eval_t >
+struct bool_check
+{
+    using object_t = typename eval_t::object_t;
+
+    void visit( eval_t& eval ) {
+        const object_t& operand = eval.state._values.top();
+        if ( ! operand.template has_value< bool >() )
+            throw std::runtime_error( "operand is not a Bool: "s + operand.to_string() );
+    }
+};
+
+/** The right operand of && and || is evaluated only if the left operand
+ *  is not decisive. **/
+template < typename eval_t >
+struct short_circuit
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+    using object_t = typename eval_t::object_t;
+
+    bool decisive;
+    ast_node_ptr right;
+
+    short_circuit( bool decisive, ast_node_ptr right )
+        : decisive( decisive )
+        , right( std::move( right ) ) {}
+
+    void visit( eval_t& eval ) {
+        const object_t& left = eval.state._values.top();
+        if ( ! left.template has_value< bool >() )
+            throw std::runtime_error( "operand is not a Bool: "s + left.to_string() );
+        if ( left.template get_value< bool >() == decisive )
+            return;
+        eval.state.pop_value();
+        eval.state.push_cell( bool_check< eval_t >() );
+        eval.push( right );
+    }
+};
+
+template < typename eval_t >
+struct short_circuit_init
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+
+    bool decisive;
+    ast_node_ptr left;
+    ast_node_ptr right;
+
+    short_circuit_init( bool decisive, ast_node_ptr left, ast_node_ptr right )
+        : decisive( decisive )
+        , left( std::move( left ) )
+        , right( std::move( right ) ) {}
+
+    void visit( eval_t& eval ) {
+        eval.state.push_cell( short_circuit< eval_t >( decisive, std::move( right ) ) );
+        eval.push( left );
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Records and types
+///////////////////////////////////////////////////////////////////////////////
+
+/** Binds the constructors of a record or a type in the expression. **/
+template < typename eval_t >
+struct constructor_bind
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+    using object_t = typename eval_t::object_t;
+
+    std::vector< std::pair< identifier_t, object_t > > constructors;
+    ast_node_ptr expression;
+
+    constructor_bind( std::vector< std::pair< identifier_t, object_t > > constructors
+                    , ast_node_ptr expression )
+        : constructors( std::move( constructors ) )
+        , expression( std::move( expression ) ) {}
+
+    void visit( eval_t& eval ) {
+        if ( ! expression.get() ) {
+            for ( auto& [ name, constructor ] : constructors )
+                eval.state._store.bind( name, std::move( constructor ) );
+            return;
+        }
+        eval.state._store.add_scope();
+        for ( auto& [ name, constructor ] : constructors )
+            eval.state._store.bind( name, std::move( constructor ) );
+        eval.state.push_cell( scope_pop< eval_t >() );
+        eval.push( expression );
+    }
+};
+
+/** Replaces the record on the value stack by its field, the offsets were
+ *  resolved by the parser, the name of the record picks the offset among
+ *  the records declaring the field, so this is a single indexed load. **/
+template < typename eval_t >
+struct field_load
+{
+    using object_t = typename eval_t::object_t;
+    using attrs_t = typename object_t::attrs_t;
+
+    identifier_t field;
+    std::vector< std::pair< identifier_t, int > > offsets;
+
+    field_load( identifier_t field, std::vector< std::pair< identifier_t, int > > offsets )
+        : field( std::move( field ) )
+        , offsets( std::move( offsets ) ) {}
+
+    void visit( eval_t& eval ) {
+        object_t o = eval.state.pop_value();
+        attrs_t* attrs = std::get_if< attrs_t >( &o.content );
+        auto it = std::find_if( offsets.begin(), offsets.end(),
+                                [ & ]( const auto& r ){ return r.first == o.name; } );
+        if ( it == offsets.end() || attrs == nullptr || it->second >= attrs->size() ) {
+            std::string records;
+            for ( const auto& [ record, offset ] : offsets )
+                records += ( records.empty() ? "" : " or " ) + record;
+            throw std::runtime_error( "expected a "s + records + " with the field "
+                                    + field + " but got " + o.to_string() );
+        }
+        eval.state.push_value( std::move( ( *attrs )[ it->second ] ) );
+    }
+};
+
+template < typename eval_t >
+struct field_init
+{
+    using ast_node_ptr = typename eval_t::ast_node_ptr;
+
+    ast_node_ptr record;
+    field_load< eval_t > load;
+
+    field_init( ast_node_ptr record, field_load< eval_t > load )
+        : record( std::move( record ) )
+        , load( std::move( load ) ) {}
+
+    void visit( eval_t& eval ) {
+        eval.state.push_cell( std::move( load ) );
+        eval.push( record );
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Continuations
+///////////////////////////////////////////////////////////////////////////////
+
+/** Builtins, which call back into the evaluator, continue in a native cell
+ *  once the values they wait for are on the value stack. **/
+template < typename eval_t >
+struct native
+{
+    std::function< void( eval_t& ) > f;
+
+    native( std::function< void( eval_t& ) > f ) : f( std::move( f ) ) {}
+
+    void visit( eval_t& eval ) {
+        f( eval );
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Loops
+///////////////////////////////////////////////////////////////////////////////
+
+/** Scope, in which a native loop calls a function repeatedly. The closure
+ *  of a function with a single path of variable patterns is bound once,
+ *  every call then only assigns the argument slots, see
+ *  eval::call_in_frame. **/
+template < typename types >
+struct call_frame
+{
+    using fun_obj_t = typename types::fun_obj_t;
+    using closure_t = typename types::closure_t;
+
+    fun_obj_t fun;
+    bool reusable = false;
+    bool open = false;
+    // first slot of the frame and the slots of the arguments, -1 for _
+    int base = 0;
+    std::vector< int > slots;
+
+    call_frame( fun_obj_t f ) : fun( std::move( f ) )
+    {
+        reusable = fun.paths.size() == 1
+                && std::holds_alternative< closure_t >( fun.paths[ 0 ].evaluable );
+        if ( reusable )
+            for ( const auto& p : fun.paths[ 0 ].input_patterns )
+                reusable = reusable && std::holds_alternative< variable_pattern >( p );
+    }
+};
+
+/** Native loop of a builtin. The step is called with the result of the
+ *  previous call on the value stack, it either calls the function in the
+ *  frame and returns true, or leaves the result of the loop on the value
+ *  stack and returns false. **/
+template < typename eval_t >
+struct loop_state
+{
+    using frame_t = call_frame< typename eval_t::types >;
+
+    frame_t frame;
+    std::function< bool( eval_t&, frame_t& ) > step;
+};
+
+template < typename eval_t >
+struct loop_step
+{
+    std::shared_ptr< loop_state< eval_t > > loop;
+
+    loop_step( std::shared_ptr< loop_state< eval_t > > loop ) : loop( std::move( loop ) ) {}
+
+    void visit( eval_t& eval ) {
+        eval.state.push_cell( *this );
+        if ( loop->step( eval, loop->frame ) )
+            return;
+        eval.state._cells.pop_back();
+        eval.close_frame( loop->frame );
+    }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Translators
 ///////////////////////////////////////////////////////////////////////////////
@@ -292,16 +785,37 @@ public:
         return literal< eval_t >( l.value );
     }
 
+    static eval_cell_t accept( const ast::literal< std::string > &l, eval_t& eval )
+    {
+        return literal< eval_t >( object_t( text( l.value ) ) );
+    }
+
     static eval_cell_t accept( const ast::variable& v, eval_t& eval )
     {
-        return variable< eval_t >( v.name );
+        return variable< eval_t >( v.name, v.last_use );
+    }
+
+    /** Operators can not be rebound, so && and || always refer to the
+     *  builtins and are lowered to conditional evaluation. **/
+    static std::optional< bool > short_circuit_operator( const ast::function_call& f )
+    {
+        const auto* op = std::get_if< ast::variable >( &*f.fun );
+        if ( op == nullptr || f.args.size() != 2 )
+            return {};
+        if ( op->name == "&&" )
+            return false;
+        if ( op->name == "||" )
+            return true;
+        return {};
     }
 
     static eval_cell_t accept( const ast::function_call& f, eval_t& eval )
     {
-        auto arguments = f.args;
-        std::reverse( arguments.begin(), arguments.end() );
-        return fun_init< eval_t >( f.fun, arguments );
+        if ( auto decisive = short_circuit_operator( f ) )
+            return short_circuit_init< eval_t >( decisive.value(), f.args[ 0 ], f.args[ 1 ] );
+
+        std::vector< ast::node_ref > arguments( f.args.rbegin(), f.args.rend() );
+        return fun_init< eval_t >( f.fun, std::move( arguments ) );
     }
 
     template< typename T >
@@ -320,7 +834,7 @@ public:
         std::vector< pattern > patterns;
         for ( const auto& child : p.patterns )
             patterns.push_back( eval_translator::tran_pattern( child ) );
-        return object_pattern( p.name, std::move( patterns ) );
+        return object_pattern( p.name, std::move( patterns ), p.tag );
     }
 
     static pattern tran_pattern( const ast::pattern& p )
@@ -341,12 +855,12 @@ public:
         using closure_t = typename eval_t::types::closure_t;
 
         auto free_variables = ast::ast_free_vars::free_variables( p );
-        auto bindings = eval.state._store.scopes.lookup( free_variables );
+        auto bindings = eval.state._store.capture( free_variables );
 
         if ( bindings.isleft() )
             throw std::runtime_error( "variable '" + bindings.left() + "' not bound" );
 
-        closure_t closure = { p.expression, bindings.right() };
+        closure_t closure = { p.expression, bindings.right(), eval.state._store.hold( bindings.right() ) };
 
         return function_path< evaluable_t >(
                 input_patterns,
@@ -354,13 +868,29 @@ public:
                 evaluable_t{ closure } );
     }
 
+    /** Captures the free variables of an expression, which is evaluated
+     *  later, see eval::force. **/
+    static object_t make_thunk( ast::node_ref n, eval_t& eval )
+    {
+        using closure_t = typename eval_t::types::closure_t;
+
+        auto free_variables = ast::ast_free_vars::free_variables( *n );
+        auto bindings = eval.state._store.capture( free_variables );
+
+        if ( bindings.isleft() )
+            throw std::runtime_error( "variable '" + bindings.left() + "' not bound" );
+
+        auto token = eval.state._store.hold( bindings.right() );
+        return object_t( typename eval_t::types::thunk_t{ closure_t{ n, bindings.right(), std::move( token ) } } );
+    }
+
     static function_object< evaluable_t > translate_fun( const ast::function_def &f
                                                        , eval_t& eval )
     {
         std::vector< function_path< evaluable_t > > paths;
         for ( const auto& f_path : f.paths )
             paths.push_back( translate_path( *f_path, eval ) );
-        return { paths, f.arity };
+        return { paths, f.arity, eval.profile( f.id ) };
     }
 
     static eval_cell_t accept( const ast::function_def& f, eval_t& eval )
@@ -370,17 +900,78 @@ public:
 
     static eval_cell_t accept( const ast::let_in& l, eval_t& eval )
     {
+        if ( l.recursive )
+            return let_rec_init< eval_t >( std::get< ast::variable_pattern >( l.pat ).name
+                                         , l.value
+                                         , l.expression );
+        if ( l.lazy )
+            return let_lazy< eval_t >( std::get< ast::variable_pattern >( l.pat ).name
+                                     , l.value
+                                     , l.expression );
         return let_in_init< eval_t >( tran_pattern( l.pat ), l.value, l.expression );
     }
 
+    static eval_cell_t accept( const ast::if_then_else& i, eval_t& eval )
+    {
+        return if_init< eval_t >( i.condition, i.then_branch, i.else_branch );
+    }
+
+    /** The constructor takes the fields in the declared order, the
+     *  arguments are moved out of its scope into the object. A constructor
+     *  without fields is the object itself. **/
+    static object_t constructor( const identifier_t& name
+                               , const std::vector< identifier_t >& fields
+                               , type_tag tag )
+    {
+        using builtin_t = typename eval_t::types::builtin_t;
+        using attrs_t = typename object_t::attrs_t;
+
+        if ( fields.empty() )
+            return object_t( name, attrs_t{}, tag.tag );
+
+        std::vector< pattern > inputs;
+        for ( const auto& f : fields )
+            inputs.push_back( variable_pattern( f ) );
+
+        builtin_t make = [ name, fields, tag = tag.tag ]( eval_t& e ) {
+            attrs_t attrs;
+            attrs.reserve( fields.size() );
+            for ( const auto& f : fields )
+                attrs.push_back( e.state._store.take( f ) );
+            e.state.push_value( object_t( name, std::move( attrs ), tag ) );
+        };
+
+        function_path< evaluable_t > path( std::move( inputs ), variable_pattern( "_" ), make );
+        return object_t( function_object< evaluable_t >( { std::move( path ) }, fields.size() ) );
+    }
+
+    static eval_cell_t accept( const ast::record_def& r, eval_t& eval )
+    {
+        return constructor_bind< eval_t >( { { r.name, constructor( r.name, r.fields, r.tag ) } }
+                                         , r.expression );
+    }
+
+    static eval_cell_t accept( const ast::type_def& t, eval_t& eval )
+    {
+        std::vector< std::pair< identifier_t, object_t > > constructors;
+        for ( const auto& c : t.constructors )
+            constructors.emplace_back( c.name, constructor( c.name, c.fields, c.tag ) );
+        return constructor_bind< eval_t >( std::move( constructors ), t.expression );
+    }
+
+    static eval_cell_t accept( const ast::field_access& f, eval_t& eval )
+    {
+        return field_init< eval_t >( f.record, field_load< eval_t >( f.field, f.offsets ) );
+    }
+
 };
 
 template < typename eval_t >
-class eval_translator< ast::node_ptr, eval_t >
+class eval_translator< ast::node_ref, eval_t >
 {
 
     using eval_cell_t = typename eval_t::eval_cell_t;
-    using ast_node_t = ast::node_ptr;
+    using ast_node_t = ast::node_ref;
     using object_t = typename eval_t::object_t;
 
 public:
@@ -405,16 +996,108 @@ struct store
     bindings_tree_t scopes;
     std::vector< object_t > _store;
 
+    /** The slots below globals_end are the globals of a program, shared with
+     *  other evaluators and never changed, the slot id of the others is
+     *  globals_end + their index in _store. **/
+    std::shared_ptr< const std::vector< object_t > > globals;
+    store_id globals_end = 0;
+
+    /** Slots are allocated as a stack, a scope frees the slots allocated
+     *  since it was added, unless they are captured by a closure. **/
+    std::vector< store_id > marks;
+    store_id captured_until = 0;
+
+    /** The closures capturing slots, in the order they were made, with the
+     *  end of the slots captured by them and the closures before them. A
+     *  closure is gone once its token expired. **/
+    struct capture_t
+    {
+        std::weak_ptr< void > token;
+        store_id until;
+    };
+    std::vector< capture_t > captures;
+
+    /** Binds the names to the shared globals. **/
+    void share_globals( const std::vector< identifier_t >& names
+                      , std::shared_ptr< const std::vector< object_t > > objects )
+    {
+        assert( _store.empty() && names.size() == objects->size() );
+        for ( store_id id = 0; id < names.size(); id++ )
+            bind( names[ id ], id );
+        globals = std::move( objects );
+        globals_end = globals->size();
+    }
+
+    /** The id of the next slot. **/
+    store_id end() const
+    {
+        return globals_end + _store.size();
+    }
+
+    const object_t& get( store_id id ) const
+    {
+        return id < globals_end ? ( *globals )[ id ] : _store[ id - globals_end ];
+    }
+
+    /** A slot which is not a global. **/
+    object_t& at( store_id id )
+    {
+        assert( id >= globals_end );
+        return _store[ id - globals_end ];
+    }
+
+    void add_scope()
+    {
+        scopes.add_scope();
+        marks.push_back( end() );
+    }
+
+    void pop_scope()
+    {
+        scopes.pop_scope();
+        // the closures made last and gone no longer keep their slots
+        while ( ! captures.empty() && captures.back().token.expired() )
+            captures.pop_back();
+        captured_until = captures.empty() ? 0 : captures.back().until;
+        store_id keep = std::max( { marks.back(), captured_until, globals_end } );
+        marks.pop_back();
+        if ( keep < end() )
+            _store.erase( _store.begin() + ( keep - globals_end ), _store.end() );
+    }
+
+    /** Looks up the slots of variables, which are referred to by a closure
+     *  and have to outlive their scope, see hold. **/
+    either< identifier_t, std::map< identifier_t, store_id > > capture( 
+        const std::set< identifier_t >& names )
+    {
+        return scopes.lookup( names );
+    }
+
+    /** The token of a closure with the captured slots, which are kept until
+     *  the token and its copies are gone. **/
+    std::shared_ptr< void > hold( const std::map< identifier_t, store_id >& bindings )
+    {
+        if ( bindings.empty() )
+            return nullptr;
+        for ( const auto &[ name, id ] : bindings )
+            captured_until = std::max( captured_until, id + 1 );
+        auto token = std::make_shared< char >();
+        captures.push_back( { token, captured_until } );
+        return token;
+    }
+
 
     void bind( identifier_t name, store_id id )
     {
         scopes.bind( std::move( name ), id );
     }
 
-    void bind( const identifier_t& name, object_t value )
+    store_id bind( const identifier_t& name, object_t value )
     {
-        bind( name, _store.size() );
+        store_id id = end();
+        bind( name, id );
         _store.push_back( std::move( value ) );
+        return id;
     }
 
     template < typename assigned_t >
@@ -423,11 +1106,16 @@ struct store
             bind( key, val );
     }
 
+    void bind( std::map< identifier_t, object_t >&& assignment ) {
+        for ( auto &[ key, val ] : assignment )
+            bind( key, std::move( val ) );
+    }
+
     void assign( identifier_t name, object_t value )
     {
         std::optional< store_id > id = scopes.lookup( name );
         if ( id.has_value() ) {
-            _store[ id.value() ] = std::move( value );
+            at( id.value() ) = std::move( value );
         } else {
             bind( std::move( name ), std::move( value ) );
         }
@@ -444,13 +1132,28 @@ struct store
             assign( key, val );
     }
 
-    object_t lookup( identifier_t name )
+    store_id lookup_id( const identifier_t& name )
     {
         std::optional< store_id > id = scopes.lookup( name );
         if ( !id.has_value() ) {
             throw std::runtime_error( "variable '"s + name + "' not bound" );
         }
-        return _store[ id.value() ];
+        return id.value();
+    }
+
+    object_t lookup( identifier_t name )
+    {
+        return get( lookup_id( name ) );
+    }
+
+    /** Moves the value out of its slot, for arguments of builtins, which
+     *  are never captured. **/
+    object_t take( const identifier_t& name )
+    {
+        store_id id = lookup_id( name );
+        if ( id < globals_end )
+            return get( id );
+        return std::move( at( id ) );
     }
 
     friend std::ostream& operator<<( std::ostream& os, const store& s )
@@ -468,7 +1171,7 @@ struct store
     {
         std::map< identifier_t, object_t > result;
         for ( const auto &[ key, value ] : bindings )
-            result.insert( { key, _store[ value ] } );
+            result.insert( { key, get( value ) } );
         return result;
     }
 
@@ -539,7 +1242,22 @@ using eval_cell = std::variant< literal< eval_t >
                               , fun_cleanup< eval_t >
                               , let_in_init< eval_t >
                               , let_in_bind< eval_t >
+                              , let_rec_init< eval_t >
+                              , let_rec_bind< eval_t >
+                              , let_lazy< eval_t >
+                              , thunk_update< eval_t >
                               , scope_pop< eval_t >
+                              , if_init< eval_t >
+                              , if_branch< eval_t >
+                              , short_circuit_init< eval_t >
+                              , short_circuit< eval_t >
+                              , bool_check< eval_t >
+                              , constructor_bind< eval_t >
+                              , field_init< eval_t >
+                              , field_load< eval_t >
+                              , loop_step< eval_t >
+                              , task_join< eval_t >
+                              , native< eval_t >
                               >;
 
 template < typename eval_t >
@@ -555,31 +1273,129 @@ struct closure
 {
     evaluable_t evaluable;
     std::map< identifier_t, store_id > bindings;
+    // keeps the captured slots, see store::hold
+    std::shared_ptr< void > token;
+};
+
+/** An unevaluated expression, passed to lazy parameters of builtins. **/
+template < typename closure_t >
+struct thunk
+{
+    closure_t closure;
+
+    bool operator ==( const thunk &o ) const { return false; };
+
+    std::size_t hash() const { return 0; }
+
+    friend std::ostream& operator <<( std::ostream& os, const thunk& t )
+    {
+        return os << "Thunk";
+    }
+};
+
+/** The value of an expression spawned as a task, see the spawn builtin.
+ *  The result keeps the slots its closures refer to, see eval::adopt. **/
+template < typename result_t >
+struct future
+{
+    std::shared_ptr< result_t > result;
+
+    bool operator ==( const future &o ) const { return result == o.result; }
+
+    std::size_t hash() const { return std::hash< const void* >()( result.get() ); }
+
+    friend std::ostream& operator <<( std::ostream& os, const future& f )
+    {
+        if ( ! f.result->done.load( std::memory_order_acquire ) )
+            return os << "pending";
+        if ( f.result->error )
+            return os << "failed";
+        return os << f.result->value;
+    }
 };
 
 template < typename eval_t >
 struct types_
 {
     using builtin_t = builtin< eval_t >;
-    using closure_t = closure< ast::node_ptr, identifier_t, int >;
+    using closure_t = closure< ast::node_ref, identifier_t, int >;
     using evaluable_t = std::variant< closure_t, builtin_t >;
     using fun_obj_t = function_object< evaluable_t >;
-    using value_t = std::variant< int
+    using thunk_t = thunk< closure_t >;
+    using stream_t = stream< object< types_ >, fun_obj_t >;
+    using int_array_t = packed_array< std::int64_t >;
+    using float_array_t = packed_array< double >;
+    using map_t = hamt< object< types_ >, object< types_ > >;
+    using future_t = future< task_result< object< types_ > > >;
+    using channel_t = channel< object< types_ > >;
+    using value_t = std::variant< int_t
+                                , bigint
+                                , double
+                                , text
                                 , bool
-                                , fun_obj_t >;
+                                , fun_obj_t
+                                , thunk_t
+                                , stream_t
+                                , int_array_t
+                                , float_array_t
+                                , map_t
+                                , future_t
+                                , channel_t >;
     template< typename T >
     static constexpr const char * type_name() {
-        if constexpr ( std::is_same< T, int >::value )
+        if constexpr ( std::is_same< T, int_t >::value )
+            return "Int";
+        else if constexpr ( std::is_same< T, bigint >::value )
             return "Int";
+        else if constexpr ( std::is_same< T, double >::value )
+            return "Float";
+        else if constexpr ( std::is_same< T, text >::value )
+            return "String";
         else if constexpr ( std::is_same< T, bool >::value )
             return "Bool";
         else if constexpr ( std::is_same< T, fun_obj_t >::value )
             return "Fun";
+        else if constexpr ( std::is_same< T, thunk_t >::value )
+            return "Thunk";
+        else if constexpr ( std::is_same< T, stream_t >::value )
+            return "Stream";
+        else if constexpr ( std::is_same< T, int_array_t >::value )
+            return "Array";
+        else if constexpr ( std::is_same< T, float_array_t >::value )
+            return "FloatArray";
+        else if constexpr ( std::is_same< T, map_t >::value )
+            return "Map";
+        else if constexpr ( std::is_same< T, future_t >::value )
+            return "Future";
+        else if constexpr ( std::is_same< T, channel_t >::value )
+            return "Channel";
         else
             assert( false );
     }
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Program
+///////////////////////////////////////////////////////////////////////////////
+
+/** The immutable part of a program, shared by the evaluators on all threads.
+ *  It owns the parsed expressions, the cells of the evaluators refer to
+ *  their nodes, and the globals. The globals are made once, the evaluators
+ *  read them from the shared slots and never change them. **/
+template < typename object_t >
+struct program_image
+{
+    std::vector< identifier_t > global_names;
+    std::shared_ptr< std::vector< object_t > > globals = std::make_shared< std::vector< object_t > >();
+    std::vector< ast::node_ptr > expressions;
+
+    void add_global( identifier_t name, object_t value )
+    {
+        global_names.push_back( std::move( name ) );
+        globals->push_back( std::move( value ) );
+    }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Evaluator
 ///////////////////////////////////////////////////////////////////////////////
@@ -589,22 +1405,112 @@ struct eval
     using types = types_< eval >;
     using object_t = object< types >;
     using eval_cell_t = eval_cell< eval >;
-    using ast_node_ptr = ast::node_ptr;
+    using ast_node_ptr = ast::node_ref;
 
     using eval_state_t = eval_state< object_t, eval_cell_t >;
 
+    using program_t = program_image< object_t >;
+
     eval_state_t state;
 
     eval_translator < ast::ast_node, eval > translator;
 
+    std::shared_ptr< const program_t > program;
+
+    /** The trees pushed by the caller, which are not part of the program.
+     *  Tasks share the list, it is copied by a push while it is shared. **/
+    std::shared_ptr< std::vector< ast::node_ptr > > roots;
+
     bool debug_mode = false;
 
+    /** Adaptive reordering of function paths, see dispatch_profile. **/
+    bool adaptive_dispatch = true;
+
+    /** Arguments are evaluated in parallel on the pool, if there is one,
+     *  see forked_arguments. **/
+    std::shared_ptr< task_pool > pool;
+
+    /** Arguments are forked only near the root of the computation, where
+     *  the calls are big enough to pay for a task. The nesting is counted in
+     *  pending cells, those of the evaluators this one is a task of are in
+     *  fork_depth. **/
+    std::size_t fork_depth = 0;
+    std::size_t fork_depth_limit = 32;
+
+    /** A task of the pool parks instead of blocking its thread, it stops
+     *  running with the wait list it is parked on, see retry. **/
+    bool resumable = false;
+    wait_list* parked = nullptr;
+    std::size_t parked_epoch = 0;
+
+    /** Shared with the tasks, made by the first task of the evaluator,
+     *  which then owns it, see actor_threads. **/
+    std::shared_ptr< actor_threads > actors;
+    bool owns_actors = false;
+
+    std::map< int, dispatch_profile_ptr > profiles;
+
     using bindings_t = eval_state_t::store_t::bindings_t;
 
+    eval() = default;
+
+    /** An evaluator of the program, its globals are in a scope below the
+     *  one of the expressions. **/
+    explicit eval( std::shared_ptr< const program_t > image ) : program( std::move( image ) )
+    {
+        state._store.scopes.add_scope();
+        state._store.share_globals( program->global_names, program->globals );
+        state._store.scopes.add_scope();
+    }
+
+    ~eval()
+    {
+        if ( owns_actors )
+            actors->stop();
+    }
+
+    /** Evaluates the i-th expression of the program. **/
+    object_t run_expression( std::size_t i )
+    {
+        push( ast::node_ref( program->expressions.at( i ) ) );
+        run();
+        return state.pop_value();
+    }
+
+    dispatch_profile_ptr profile( int fundef_id )
+    {
+        if ( ! adaptive_dispatch || fundef_id < 0 )
+            return nullptr;
+        auto& p = profiles[ fundef_id ];
+        if ( ! p )
+            p = std::make_shared< dispatch_profile >();
+        return p;
+    }
+
+    /** One line per function definition: id, number of paths, the order of
+     *  the paths and their hit counts. **/
+    void save_profile( std::ostream& os ) const
+    {
+        for ( const auto& [ id, p ] : profiles )
+            if ( p->attached() )
+                os << id << " " << *p << std::endl;
+    }
+
+    void load_profile( std::istream& is )
+    {
+        int id;
+        while ( is >> id ) {
+            auto p = std::make_shared< dispatch_profile >();
+            if ( ! ( is >> *p ) )
+                throw std::runtime_error( "malformed profile of function " + std::to_string( id ) );
+            profiles.insert_or_assign( id, std::move( p ) );
+        }
+    }
+
     void run()
     {
         pprint::PrettyPrinter printer;
-        while( !state._cells.empty() )
+        while( !state._cells.empty() && ! parked )
         {
             if ( debug_mode )  {
                 std::cin.get();
@@ -619,6 +1525,28 @@ struct eval
         }
     }
 
+    enum class run_status { finished, suspended };
+
+    /** Runs at most the given number of cells. A suspended evaluation is
+     *  resumed by the next call of run_for, run_until or run. **/
+    run_status run_for( long steps )
+    {
+        for ( ; steps > 0 && ! state._cells.empty(); steps-- )
+            run_top();
+        return state._cells.empty() ? run_status::finished : run_status::suspended;
+    }
+
+    /** Runs until the deadline, the clock is read every clock_period
+     *  cells. **/
+    run_status run_until( std::chrono::steady_clock::time_point deadline )
+    {
+        static constexpr long clock_period = 1024;
+        while ( run_for( clock_period ) == run_status::suspended )
+            if ( std::chrono::steady_clock::now() >= deadline )
+                return run_status::suspended;
+        return run_status::finished;
+    }
+
     void run_top()
     {
         eval_cell_t top_cell = state.pop_cell();
@@ -643,11 +1571,435 @@ struct eval
         f( *this );
     }
 
+    /** Calls the function on the arguments, the result is left on the value
+     *  stack. **/
+    void call( types::fun_obj_t fun, std::vector< object_t > args )
+    {
+        int arity = args.size();
+        for ( int i = arity - 1; i >= 0; i-- )
+            state.push_value( std::move( args[ i ] ) );
+        state.push_cell( fun_call< eval >( std::move( fun ), arity ) );
+    }
+
+    void push_native( std::function< void( eval& ) > f )
+    {
+        state.push_cell( native< eval >( std::move( f ) ) );
+    }
+
+    using frame_t = call_frame< types >;
+
+    /** Runs the native loop, see loop_state. **/
+    void loop( types::fun_obj_t fun, std::function< bool( eval&, frame_t& ) > step )
+    {
+        auto l = std::make_shared< loop_state< eval > >( loop_state< eval >{ frame_t( std::move( fun ) )
+                                                                           , std::move( step ) } );
+        state.push_cell( loop_step< eval >( std::move( l ) ) );
+    }
+
+    /** Calls the function of the frame like call does. A reusable frame is
+     *  opened on the first call, it is opened again once a closure captured
+     *  any of its slots, which must then outlive the call. **/
+    template < typename... args_t >
+    void call_in_frame( frame_t& frame, args_t... args )
+    {
+        if ( ! frame.reusable || sizeof...( args_t ) != frame.fun.arity() ) {
+            call( frame.fun, { std::move( args )... } );
+            return;
+        }
+        auto& store = state._store;
+        if ( frame.open && store.captured_until > frame.base )
+            close_frame( frame );
+
+        const auto& path = frame.fun.paths[ 0 ];
+        const auto& closure = std::get< types::closure_t >( path.evaluable );
+        if ( ! frame.open ) {
+            store.add_scope();
+            frame.base = store.end();
+            frame.slots.clear();
+            for ( const auto& p : path.input_patterns ) {
+                const auto& name = std::get< variable_pattern >( p ).variable_name;
+                frame.slots.push_back( name == "_" ? -1 : store.bind( name, object_t() ) );
+            }
+            store.assign( closure.bindings );
+            frame.open = true;
+        }
+
+        int i = 0;
+        ( ( frame.slots[ i ] >= 0 ? void( store.at( frame.slots[ i ] ) = std::move( args ) ) : void(), i++ ), ... );
+        push( closure.evaluable );
+    }
+
+    void close_frame( frame_t& frame )
+    {
+        if ( frame.open )
+            state._store.pop_scope();
+        frame.open = false;
+    }
+
+    /** Evaluates the expression of the thunk in its own scope, the value is
+     *  left on the value stack. **/
+    void force( const types::thunk_t& t )
+    {
+        state.push_cell( scope_pop< eval >() );
+        state._store.add_scope();
+        evaluate( t.closure );
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Parallel arguments
+    ///////////////////////////////////////////////////////////////////////////
+
+    /** The profiles of adaptive dispatch are not synchronized, so they are
+     *  turned off in the parallel mode, see also task_job. **/
+    void enable_parallel( int threads )
+    {
+        pool = std::make_shared< task_pool >( threads );
+        adaptive_dispatch = false;
+    }
+
+    /** An expression is worth a task if it calls a function defined in
+     *  Squid, calls of builtins on variables and literals stay inline. **/
+    bool worth_task( const ast::ast_node& n )
+    {
+        if ( const auto* call = std::get_if< ast::function_call >( &n ) ) {
+            if ( const auto* callee = std::get_if< ast::variable >( &*call->fun ) ) {
+                auto slot = state._store.scopes.lookup( callee->name );
+                if ( ! slot )
+                    return true;
+                const object_t& f = state._store.get( slot.value() );
+                if ( f.template has_value< types::fun_obj_t >()
+                  && std::holds_alternative< types::closure_t >(
+                         f.template get_value< types::fun_obj_t >().paths[ 0 ].evaluable ) )
+                    return true;
+            } else {
+                return true;
+            }
+            for ( const auto& a : call->args )
+                if ( worth_task( *a ) )
+                    return true;
+            return false;
+        }
+        if ( const auto* i = std::get_if< ast::if_then_else >( &n ) )
+            return worth_task( *i->condition ) || worth_task( *i->then_branch ) || worth_task( *i->else_branch );
+        if ( const auto* l = std::get_if< ast::let_in >( &n ) )
+            return worth_task( *l->value ) || worth_task( *l->expression );
+        return false;
+    }
+
+    /** Forks all but one of the arguments worth a task, if there are at least
+     *  two of them, the pool is not saturated and the call is not nested too
+     *  deep, see fork_depth. The arguments are in reverse, as in fun_args. **/
+    std::vector< bool > forked_arguments( const std::vector< ast_node_ptr >& args
+                                        , int arity
+                                        , const std::vector< bool >& lazy )
+    {
+        std::vector< bool > forked( arity, false );
+        if ( ! pool || arity < 2 || pool->saturated()
+          || fork_depth + state._cells.size() >= fork_depth_limit )
+            return forked;
+        std::vector< int > candidates;
+        for ( int i = 0; i < arity; i++ )
+            if ( ! ( i < lazy.size() && lazy[ i ] ) && worth_task( *args[ args.size() - 1 - i ] ) )
+                candidates.push_back( i );
+        if ( candidates.size() < 2 )
+            return forked;
+        // the first candidate is evaluated last, inline, while the others run
+        for ( int k = 1; k < candidates.size(); k++ )
+            forked[ candidates[ k ] ] = true;
+        return forked;
+    }
+
+    /** Functions, thunks and streams refer to slots of the store. **/
+    static bool holds_closures( const object_t& o )
+    {
+        if ( ! o.omega() ) {
+            for ( const auto& a : o.get_attrs() )
+                if ( holds_closures( a ) )
+                    return true;
+            return false;
+        }
+        if ( const auto* m = std::get_if< types::map_t >( &std::get< types::value_t >( o.content ) ) ) {
+            bool found = false;
+            m->for_each( [ & ]( const object_t& k, const object_t& v ) {
+                found = found || holds_closures( k ) || holds_closures( v ); } );
+            return found;
+        }
+        return o.template has_value< types::fun_obj_t >()
+            || o.template has_value< types::thunk_t >()
+            || o.template has_value< types::stream_t >();
+    }
+
+    /** The value of a finished task in the store of this evaluator. The
+     *  slots of the task its closures refer to are appended to the store,
+     *  the closures are rebased on them and held here, as are those which
+     *  refer to the copied slots only. The result is not changed, so it may
+     *  be adopted again. **/
+    object_t adopt( const task_result< object_t >& t )
+    {
+        if ( ! t.escaped )
+            return t.value;
+        int shift = state._store.end() - t.prefix;
+        for ( const object_t& slot : t.slots )
+            state._store._store.push_back( rebase( slot, t.prefix, shift ) );
+        return rebase( t.value, t.prefix, shift );
+    }
+
+    types::closure_t rebase( types::closure_t c, int from, int shift )
+    {
+        for ( auto& [ name, id ] : c.bindings )
+            if ( id >= from )
+                id += shift;
+        c.token = state._store.hold( c.bindings );
+        return c;
+    }
+
+    types::stream_t rebase( const types::stream_t& s, int from, int shift )
+    {
+        using node_t = typename types::stream_t::node_t;
+        return std::visit( [ & ]( const auto& kind ) {
+            using kind_t = std::decay_t< decltype( kind ) >;
+            kind_t copy = kind;
+            if constexpr ( std::is_same< kind_t, typename node_t::unfold >::value ) {
+                copy.step = rebase( copy.step, from, shift );
+                copy.seed = rebase( copy.seed, from, shift );
+            } else if constexpr ( std::is_same< kind_t, typename node_t::map >::value ) {
+                copy.fun = rebase( copy.fun, from, shift );
+                copy.source = rebase( copy.source, from, shift );
+            } else if constexpr ( std::is_same< kind_t, typename node_t::filter >::value ) {
+                copy.predicate = rebase( copy.predicate, from, shift );
+                copy.source = rebase( copy.source, from, shift );
+            } else if constexpr ( std::is_same< kind_t, typename node_t::take >::value ) {
+                copy.source = rebase( copy.source, from, shift );
+            }
+            return types::stream_t::make( std::move( copy ) );
+        }, s.node->kind );
+    }
+
+    types::fun_obj_t rebase( types::fun_obj_t f, int from, int shift )
+    {
+        for ( auto& path : f.paths )
+            if ( auto* c = std::get_if< types::closure_t >( &path.evaluable ) )
+                *c = rebase( std::move( *c ), from, shift );
+        return f;
+    }
+
+    /** A copy of the object whose closures refer to the slots from the
+     *  slot from on shifted by shift. **/
+    object_t rebase( const object_t& o, int from, int shift )
+    {
+        if ( ! o.omega() ) {
+            typename object_t::attrs_t attrs;
+            attrs.reserve( o.get_attrs().size() );
+            for ( const auto& a : o.get_attrs() )
+                attrs.push_back( rebase( a, from, shift ) );
+            return object_t( o.name, std::move( attrs ), o.tag );
+        }
+        const auto& value = std::get< types::value_t >( o.content );
+        if ( const auto* f = std::get_if< types::fun_obj_t >( &value ) )
+            return object_t( o.name, types::value_t( rebase( *f, from, shift ) ) );
+        if ( const auto* t = std::get_if< types::thunk_t >( &value ) )
+            return object_t( o.name, types::value_t( types::thunk_t{ rebase( t->closure, from, shift ) } ) );
+        if ( const auto* s = std::get_if< types::stream_t >( &value ) )
+            return object_t( o.name, types::value_t( rebase( *s, from, shift ) ) );
+        if ( const auto* m = std::get_if< types::map_t >( &value ) ) {
+            types::map_t copy;
+            m->for_each( [ & ]( const object_t& k, const object_t& v ) {
+                copy = copy.insert( rebase( k, from, shift ), rebase( v, from, shift ) ); } );
+            return object_t( o.name, types::value_t( std::move( copy ) ) );
+        }
+        return o;
+    }
+
+    /** Runs body( task ) on a new evaluator, on the pool if there is one,
+     *  right away otherwise. The evaluator has its own stacks and a copy of
+     *  the slots, which closures may refer to. The body leaves a value on
+     *  the value stack of the task, or it throws. **/
+    template < typename body_t >
+    std::shared_ptr< task_result< object_t > > run_task( body_t body )
+    {
+        auto result = std::make_shared< task_result< object_t > >();
+        auto job = task_job( std::move( body ), result, pool != nullptr );
+        if ( pool )
+            pool->submit( std::move( job ) );
+        else
+            job();
+        return result;
+    }
+
+    /** Runs body( task ) like run_task, on a thread of its own, which is
+     *  joined when the evaluation is over, see actor_threads. **/
+    template < typename body_t >
+    std::shared_ptr< task_result< object_t > > run_thread( body_t body )
+    {
+        auto result = std::make_shared< task_result< object_t > >();
+        auto job = task_job( std::move( body ), result, false );
+        actors->start( std::move( job ) );
+        return result;
+    }
+
+    /** Runs other tasks of the pool until the predicate holds, or backs off
+     *  without a pool. Gives up, once the actors are stopped. **/
+    template < typename pred_t >
+    void block_until( pred_t done )
+    {
+        auto stopped = [ this ]{ return actors && actors->stopping.load(); };
+        if ( pool )
+            pool->help_until( [ & ]{ return done() || stopped(); } );
+        else
+            for ( int spins = 0; ! done() && ! stopped(); spins++ )
+                if ( spins < 64 )
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for( std::chrono::microseconds( 50 ) );
+        if ( ! done() )
+            throw std::runtime_error( "stopped waiting, the evaluation is over" );
+    }
+
+    /** Runs the attempt until it succeeds, it is tried again whenever the
+     *  wait list is notified. A task of the pool parks in between, it leaves
+     *  the attempt in a native cell and stops running, until the notify
+     *  submits it again, see task_job. Other evaluators block. **/
+    void retry( wait_list& list, std::function< bool( eval& ) > attempt )
+    {
+        std::size_t seen = list.epoch();
+        if ( attempt( *this ) )
+            return;
+        if ( ! resumable ) {
+            // the predicate of block_until may be evaluated again once it holds
+            bool done = false;
+            block_until( [ & ]{ return done || ( done = attempt( *this ) ); } );
+            return;
+        }
+        state.push_cell( native< eval >( [ &list, attempt ]( eval& e ){ e.retry( list, attempt ); } ) );
+        parked = &list;
+        parked_epoch = seen;
+    }
+
+    /** Waits for the task, rethrows its error. **/
+    void wait( const task_result< object_t >& t )
+    {
+        block_until( [ & ]{ return t.done.load( std::memory_order_acquire ); } );
+        if ( t.error )
+            std::rethrow_exception( t.error );
+    }
+
+    /** The job of a task, the trees of the evaluator are kept alive for
+     *  tasks outliving it. A resumable task runs on the pool, see retry. The functions copied to the task share their
+     *  profiles with this evaluator, which stops using them, as tasks do. **/
+    template < typename body_t >
+    std::function< void() > task_job( body_t body, std::shared_ptr< task_result< object_t > > result, bool resumable )
+    {
+        adaptive_dispatch = false;
+        if ( ! actors ) {
+            actors = std::make_shared< actor_threads >();
+            owns_actors = true;
+        }
+        // the globals are shared, the other slots are copied
+        const auto& store = state._store;
+        int prefix = std::max( store.captured_until, store.globals_end );
+        std::vector< object_t > slots( store._store.begin()
+                                     , store._store.begin() + ( prefix - store.globals_end ) );
+
+        return [ program = program, roots = roots, pool = pool, actors = actors, globals = store.globals
+               , depth = fork_depth + state._cells.size(), limit = fork_depth_limit
+               , globals_end = store.globals_end, slots = std::move( slots )
+               , prefix, resumable, body = std::move( body ), result = std::move( result ) ]() mutable {
+            auto task = std::make_shared< eval >();
+            task->program = std::move( program );
+            task->roots = std::move( roots );
+            task->pool = std::move( pool );
+            task->actors = std::move( actors );
+            task->resumable = resumable;
+            task->adaptive_dispatch = false;
+            task->fork_depth = depth;
+            task->fork_depth_limit = limit;
+            task->state._store.globals = std::move( globals );
+            task->state._store.globals_end = globals_end;
+            task->state._store._store = std::move( slots );
+            task->state._store.captured_until = prefix;
+            task->state._store.scopes.add_scope();
+            try {
+                body( *task );
+            } catch ( ... ) {
+                result->error = std::current_exception();
+                task.reset();
+                finish( *result );
+                return;
+            }
+            resume( std::move( task ), std::move( result ), prefix );
+        };
+    }
+
+    /** Runs the task until it is done or it parks, a parked task is
+     *  submitted to the pool again by the wait list it is parked on. The
+     *  task is released before it is done, as the owner of the pool may go
+     *  away then. **/
+    static void resume( std::shared_ptr< eval > task, std::shared_ptr< task_result< object_t > > result, int prefix )
+    {
+        try {
+            task->run();
+            if ( task->parked ) {
+                wait_list& list = *std::exchange( task->parked, nullptr );
+                std::size_t seen = task->parked_epoch;
+                list.add( [ task = std::move( task ), result = std::move( result ), prefix ]() mutable {
+                    task_pool* pool = task->pool.get();
+                    pool->submit( [ task = std::move( task ), result = std::move( result ), prefix ]() mutable {
+                        resume( std::move( task ), std::move( result ), prefix ); } );
+                }, seen );
+                return;
+            }
+            result->value = task->state.pop_value();
+            if ( holds_closures( result->value ) ) {
+                auto& store = task->state._store;
+                result->escaped = true;
+                result->prefix = prefix;
+                result->slots.assign( std::make_move_iterator( store._store.begin() + ( prefix - store.globals_end ) )
+                                    , std::make_move_iterator( store._store.end() ) );
+            }
+        } catch ( ... ) {
+            result->error = std::current_exception();
+        }
+        task.reset();
+        finish( *result );
+    }
+
+    static void finish( task_result< object_t >& result )
+    {
+        result.done.store( true, std::memory_order_release );
+        result.completed.notify();
+    }
+
+    /** Evaluates the expression as a task, its free variables are bound
+     *  like those of a thunk. **/
+    std::shared_ptr< task_result< object_t > > fork( const ast_node_ptr& n )
+    {
+        object_t thunk = translator.make_thunk( n, *this );
+        return run_task( [ thunk ]( eval& task ) {
+            task.force( thunk.template get_value< types::thunk_t >() );
+        } );
+    }
+
     void push( const eval_cell_t& cell )
     {
         state.push_cell( cell );
     }
 
+    /** Evaluates a tree of the caller, the evaluator keeps it alive. **/
+    void push( const ast::node_ptr& n )
+    {
+        if ( ! roots )
+            roots = std::make_shared< std::vector< ast::node_ptr > >();
+        else if ( roots.use_count() > 1 )
+            roots = std::make_shared< std::vector< ast::node_ptr > >( *roots );
+        roots->push_back( n );
+        push( ast::node_ref( n ) );
+    }
+
+    void push( ast::ast_node n )
+    {
+        push( std::make_shared< ast::ast_node >( std::move( n ) ) );
+    }
+
     template < typename T >
     void push( const T& something )
     {
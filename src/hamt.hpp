@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+/** Persistent hash array mapped trie. Every level consumes five bits of the
+ *  hash, a node keeps bitmaps of its occupied slots and stores the entries
+ *  and the subtrees densely, in the order of the bits. An update copies the
+ *  path from the root, the rest of the trie is shared with the previous
+ *  version. Keys with equal hashes end up in a collision node once all the
+ *  bits of the hash are used. Keys provide hash() and ==. **/
+template < typename key_t, typename value_t >
+struct hamt
+{
+    static constexpr unsigned bits = 5;
+    static constexpr unsigned hash_bits = 8 * sizeof( std::size_t );
+
+    struct entry
+    {
+        key_t key;
+        value_t value;
+    };
+
+    struct node;
+
+    using entry_ptr = std::shared_ptr< const entry >;
+    using node_ptr = std::shared_ptr< const node >;
+
+    /** A node on the depth, where shift >= hash_bits, is a collision node,
+     *  it has no bitmaps and its entries are searched linearly. **/
+    struct node
+    {
+        std::uint32_t datamap = 0;
+        std::uint32_t nodemap = 0;
+        std::vector< entry_ptr > entries;
+        std::vector< node_ptr > children;
+
+        bool empty() const { return entries.empty() && children.empty(); }
+    };
+
+    node_ptr root;
+    std::size_t count = 0;
+
+    std::size_t size() const { return count; }
+
+    const value_t* find( const key_t& key ) const
+    {
+        std::size_t h = key.hash();
+        const node* n = root.get();
+        for ( unsigned shift = 0; n != nullptr; shift += bits ) {
+            if ( shift >= hash_bits ) {
+                for ( const auto& e : n->entries )
+                    if ( e->key == key )
+                        return &e->value;
+                return nullptr;
+            }
+            std::uint32_t bit = bit_of( h, shift );
+            if ( n->datamap & bit ) {
+                const entry& e = *n->entries[ index( n->datamap, bit ) ];
+                return e.key == key ? &e.value : nullptr;
+            }
+            if ( ! ( n->nodemap & bit ) )
+                return nullptr;
+            n = n->children[ index( n->nodemap, bit ) ].get();
+        }
+        return nullptr;
+    }
+
+    hamt insert( key_t key, value_t value ) const
+    {
+        std::size_t h = key.hash();
+        bool added = false;
+        hamt result;
+        result.root = insert( root.get()
+                            , std::make_shared< const entry >( entry{ std::move( key )
+                                                                    , std::move( value ) } )
+                            , h, 0, added );
+        result.count = count + added;
+        return result;
+    }
+
+    hamt remove( const key_t& key ) const
+    {
+        bool removed = false;
+        hamt result;
+        result.root = remove( root, key, key.hash(), 0, removed );
+        result.count = count - removed;
+        return result;
+    }
+
+    /** Calls f( key, value ) for every entry, in the order of the hashes. **/
+    template < typename fun_t >
+    void for_each( fun_t&& f ) const
+    {
+        if ( root )
+            for_each( *root, f );
+    }
+
+    bool operator ==( const hamt& o ) const
+    {
+        if ( count != o.count )
+            return false;
+        bool equal = true;
+        for_each( [&]( const key_t& k, const value_t& v ) {
+            const value_t* w = o.find( k );
+            equal = equal && w != nullptr && *w == v;
+        } );
+        return equal;
+    }
+
+    /** Independent of the shape of the trie, which depends on the history of
+     *  updates. **/
+    std::size_t hash() const
+    {
+        std::size_t h = count;
+        for_each( [&]( const key_t& k, const value_t& v ) {
+            h += k.hash() * 31 + v.hash();
+        } );
+        return h;
+    }
+
+    friend std::ostream& operator <<( std::ostream& os, const hamt& m )
+    {
+        const std::size_t shown = 16;
+        std::size_t i = 0;
+        os << "Map {";
+        m.for_each( [&]( const key_t& k, const value_t& v ) {
+            if ( i++ < shown )
+                os << " " << k << " -> " << v << ";";
+        } );
+        if ( m.size() > shown )
+            os << " ... (" << m.size() << ")";
+        return os << " }";
+    }
+
+private:
+    static std::uint32_t bit_of( std::size_t h, unsigned shift )
+    {
+        return std::uint32_t( 1 ) << ( ( h >> shift ) & 31 );
+    }
+
+    /** Position of the slot among the occupied slots of the bitmap. **/
+    static std::size_t index( std::uint32_t bitmap, std::uint32_t bit )
+    {
+        return __builtin_popcount( bitmap & ( bit - 1 ) );
+    }
+
+    static node_ptr insert( const node* n, entry_ptr e, std::size_t h
+                          , unsigned shift, bool& added )
+    {
+        auto copy = n ? std::make_shared< node >( *n ) : std::make_shared< node >();
+
+        if ( shift >= hash_bits ) {
+            for ( auto& old : copy->entries )
+                if ( old->key == e->key ) {
+                    old = std::move( e );
+                    return copy;
+                }
+            copy->entries.push_back( std::move( e ) );
+            added = true;
+            return copy;
+        }
+
+        std::uint32_t bit = bit_of( h, shift );
+        if ( copy->datamap & bit ) {
+            std::size_t i = index( copy->datamap, bit );
+            entry_ptr old = copy->entries[ i ];
+            if ( old->key == e->key ) {
+                copy->entries[ i ] = std::move( e );
+                return copy;
+            }
+
+            bool ignored = false;
+            node_ptr child = insert( nullptr, old, old->key.hash(), shift + bits, ignored );
+            child = insert( child.get(), std::move( e ), h, shift + bits, ignored );
+
+            copy->entries.erase( copy->entries.begin() + i );
+            copy->datamap ^= bit;
+            copy->nodemap |= bit;
+            copy->children.insert( copy->children.begin() + index( copy->nodemap, bit )
+                                 , std::move( child ) );
+            added = true;
+        } else if ( copy->nodemap & bit ) {
+            std::size_t i = index( copy->nodemap, bit );
+            copy->children[ i ] = insert( copy->children[ i ].get(), std::move( e )
+                                        , h, shift + bits, added );
+        } else {
+            copy->datamap |= bit;
+            copy->entries.insert( copy->entries.begin() + index( copy->datamap, bit )
+                                , std::move( e ) );
+            added = true;
+        }
+        return copy;
+    }
+
+    /** A subtree left with a single entry is inlined into its parent, an
+     *  empty node is replaced by nullptr. **/
+    static node_ptr remove( const node_ptr& n, const key_t& key, std::size_t h
+                          , unsigned shift, bool& removed )
+    {
+        if ( ! n )
+            return n;
+
+        if ( shift >= hash_bits ) {
+            for ( std::size_t i = 0; i < n->entries.size(); i++ )
+                if ( n->entries[ i ]->key == key ) {
+                    auto copy = std::make_shared< node >( *n );
+                    copy->entries.erase( copy->entries.begin() + i );
+                    removed = true;
+                    return compact( copy );
+                }
+            return n;
+        }
+
+        std::uint32_t bit = bit_of( h, shift );
+        if ( n->datamap & bit ) {
+            std::size_t i = index( n->datamap, bit );
+            if ( ! ( n->entries[ i ]->key == key ) )
+                return n;
+            auto copy = std::make_shared< node >( *n );
+            copy->entries.erase( copy->entries.begin() + i );
+            copy->datamap ^= bit;
+            removed = true;
+            return compact( copy );
+        }
+
+        if ( ! ( n->nodemap & bit ) )
+            return n;
+
+        std::size_t i = index( n->nodemap, bit );
+        node_ptr child = remove( n->children[ i ], key, h, shift + bits, removed );
+        if ( ! removed )
+            return n;
+
+        auto copy = std::make_shared< node >( *n );
+        if ( child && ( ! child->children.empty() || child->entries.size() > 1 ) ) {
+            copy->children[ i ] = std::move( child );
+            return copy;
+        }
+
+        copy->children.erase( copy->children.begin() + i );
+        copy->nodemap ^= bit;
+        if ( child ) {
+            copy->datamap |= bit;
+            copy->entries.insert( copy->entries.begin() + index( copy->datamap, bit )
+                                , child->entries[ 0 ] );
+        }
+        return compact( copy );
+    }
+
+    static node_ptr compact( const std::shared_ptr< node >& n )
+    {
+        return n->empty() ? nullptr : n;
+    }
+
+    template < typename fun_t >
+    static void for_each( const node& n, fun_t& f )
+    {
+        for ( const auto& e : n.entries )
+            f( e->key, e->value );
+        for ( const auto& child : n.children )
+            for_each( *child, f );
+    }
+};
@@ -0,0 +1,131 @@
+#include <cassert>
+#include <map>
+
+#include "hamt.hpp"
+
+/** Key with a chosen hash, so that the collisions can be forced. **/
+struct key
+{
+    int id;
+    std::size_t h;
+
+    key( int id ) : id( id ), h( id * 2654435761u ) {}
+    key( int id, std::size_t h ) : id( id ), h( h ) {}
+
+    std::size_t hash() const { return h; }
+    bool operator ==( const key& o ) const { return id == o.id; }
+};
+
+struct value
+{
+    int v;
+
+    std::size_t hash() const { return v; }
+    bool operator ==( const value& o ) const { return v == o.v; }
+};
+
+using map_t = hamt< key, value >;
+
+void check( const map_t& m, const std::map< int, int >& expected, bool colliding = false )
+{
+    assert( m.size() == expected.size() );
+    for ( const auto& [ k, v ] : expected ) {
+        const value* found = m.find( colliding ? key( k, 42 ) : key( k ) );
+        assert( found && found->v == v );
+    }
+    std::size_t visited = 0;
+    m.for_each( [&]( const key& k, const value& v ) {
+        assert( expected.at( k.id ) == v.v );
+        visited++;
+    } );
+    assert( visited == expected.size() );
+}
+
+void test_insert_remove()
+{
+    map_t m;
+    std::map< int, int > expected;
+
+    for ( int i = 0; i < 5000; i++ ) {
+        m = m.insert( key( i ), value{ i * i } );
+        expected[ i ] = i * i;
+    }
+    check( m, expected );
+    assert( m.find( key( 5000 ) ) == nullptr );
+
+    m = m.insert( key( 7 ), value{ 0 } );
+    expected[ 7 ] = 0;
+    check( m, expected );
+
+    for ( int i = 0; i < 5000; i += 3 ) {
+        m = m.remove( key( i ) );
+        expected.erase( i );
+    }
+    check( m, expected );
+
+    m = m.remove( key( 0 ) );
+    check( m, expected );
+
+    for ( int i = 0; i < 5000; i++ )
+        m = m.remove( key( i ) );
+    assert( m.size() == 0 && ! m.root );
+}
+
+void test_persistence()
+{
+    map_t a;
+    for ( int i = 0; i < 100; i++ )
+        a = a.insert( key( i ), value{ i } );
+
+    map_t b = a.insert( key( 100 ), value{ 100 } ).remove( key( 5 ) );
+    assert( a.size() == 100 && b.size() == 100 );
+    assert( a.find( key( 5 ) ) && ! b.find( key( 5 ) ) );
+    assert( ! a.find( key( 100 ) ) && b.find( key( 100 ) ) );
+
+    // the untouched subtrees are shared
+    std::size_t shared = 0;
+    for ( std::size_t i = 0; i < a.root->children.size(); i++ )
+        for ( std::size_t j = 0; j < b.root->children.size(); j++ )
+            shared += a.root->children[ i ] == b.root->children[ j ];
+    assert( shared + 2 >= a.root->children.size() );
+}
+
+void test_collisions()
+{
+    map_t m;
+    std::map< int, int > expected;
+    for ( int i = 0; i < 10; i++ ) {
+        m = m.insert( key( i, 42 ), value{ i } );
+        expected[ i ] = i;
+    }
+    check( m, expected, true );
+    assert( ! m.find( key( 10, 42 ) ) );
+
+    for ( int i = 0; i < 9; i++ ) {
+        m = m.remove( key( i, 42 ) );
+        expected.erase( i );
+        check( m, expected, true );
+    }
+    // the last entry is pulled up to the root
+    assert( m.root->entries.size() == 1 && m.root->children.empty() );
+}
+
+void test_equality()
+{
+    map_t a, b;
+    for ( int i = 0; i < 50; i++ ) {
+        a = a.insert( key( i ), value{ i } );
+        b = b.insert( key( 49 - i ), value{ 49 - i } );
+    }
+    assert( a == b && a.hash() == b.hash() );
+    assert( ! ( a == b.insert( key( 3 ), value{ 4 } ) ) );
+    assert( ! ( a == b.remove( key( 3 ) ) ) );
+}
+
+int main()
+{
+    test_insert_remove();
+    test_persistence();
+    test_collisions();
+    test_equality();
+}
@@ -0,0 +1,542 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+/** Bulk operations over contiguous int64 and double buffers. The
+ *  instruction set is chosen at compile time, AVX2 with -mavx2 (or
+ *  -march=native), SSE2 on any x86-64 and a scalar loop otherwise. Every
+ *  kernel handles the tail, which does not fill a vector register, with the
+ *  scalar loop. The output may alias an input. **/
+namespace kernels
+{
+    using i64 = std::int64_t;
+
+    /** The Int kernels return false if a result does not fit in int64, the
+     *  output is then unspecified. The sum r = x + y overflows iff x and y
+     *  have the same sign and r has the other one, that is the sign bit of
+     *  ( x ^ r ) & ( y ^ r ), the difference r = x - y iff the sign bit of
+     *  ( x ^ y ) & ( x ^ r ) is set. The vector loops collect the bits and
+     *  test them once. **/
+#if defined( __AVX2__ )
+    inline bool none_negative( __m256i bits )
+    {
+        return _mm256_movemask_pd( _mm256_castsi256_pd( bits ) ) == 0;
+    }
+#endif
+#if defined( __SSE2__ )
+    inline bool none_negative( __m128i bits )
+    {
+        return _mm_movemask_pd( _mm_castsi128_pd( bits ) ) == 0;
+    }
+#endif
+
+    inline bool add( const i64* a, const i64* b, i64* out, size_t n )
+    {
+        size_t i = 0;
+        bool overflow = false;
+#if defined( __AVX2__ )
+        __m256i bits = _mm256_setzero_si256();
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            __m256i y = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( b + i ) );
+            __m256i r = _mm256_add_epi64( x, y );
+            bits = _mm256_or_si256( bits, _mm256_and_si256( _mm256_xor_si256( x, r ), _mm256_xor_si256( y, r ) ) );
+            _mm256_storeu_si256( reinterpret_cast< __m256i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#elif defined( __SSE2__ )
+        __m128i bits = _mm_setzero_si128();
+        for ( ; i + 2 <= n; i += 2 ) {
+            __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) );
+            __m128i y = _mm_loadu_si128( reinterpret_cast< const __m128i* >( b + i ) );
+            __m128i r = _mm_add_epi64( x, y );
+            bits = _mm_or_si128( bits, _mm_and_si128( _mm_xor_si128( x, r ), _mm_xor_si128( y, r ) ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#endif
+        for ( ; i < n; i++ )
+            overflow |= __builtin_add_overflow( a[ i ], b[ i ], &out[ i ] );
+        return ! overflow;
+    }
+
+    inline bool sub( const i64* a, const i64* b, i64* out, size_t n )
+    {
+        size_t i = 0;
+        bool overflow = false;
+#if defined( __AVX2__ )
+        __m256i bits = _mm256_setzero_si256();
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            __m256i y = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( b + i ) );
+            __m256i r = _mm256_sub_epi64( x, y );
+            bits = _mm256_or_si256( bits, _mm256_and_si256( _mm256_xor_si256( x, y ), _mm256_xor_si256( x, r ) ) );
+            _mm256_storeu_si256( reinterpret_cast< __m256i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#elif defined( __SSE2__ )
+        __m128i bits = _mm_setzero_si128();
+        for ( ; i + 2 <= n; i += 2 ) {
+            __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) );
+            __m128i y = _mm_loadu_si128( reinterpret_cast< const __m128i* >( b + i ) );
+            __m128i r = _mm_sub_epi64( x, y );
+            bits = _mm_or_si128( bits, _mm_and_si128( _mm_xor_si128( x, y ), _mm_xor_si128( x, r ) ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#endif
+        for ( ; i < n; i++ )
+            overflow |= __builtin_sub_overflow( a[ i ], b[ i ], &out[ i ] );
+        return ! overflow;
+    }
+
+    /** There is no 64-bit lane multiplication below AVX-512, the loop is
+     *  left to the auto-vectorizer. **/
+    inline bool mul( const i64* a, const i64* b, i64* out, size_t n )
+    {
+        bool overflow = false;
+        for ( size_t i = 0; i < n; i++ )
+            overflow |= __builtin_mul_overflow( a[ i ], b[ i ], &out[ i ] );
+        return ! overflow;
+    }
+
+    inline bool add_scalar( const i64* a, i64 k, i64* out, size_t n )
+    {
+        size_t i = 0;
+        bool overflow = false;
+#if defined( __AVX2__ )
+        __m256i y = _mm256_set1_epi64x( k );
+        __m256i bits = _mm256_setzero_si256();
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            __m256i r = _mm256_add_epi64( x, y );
+            bits = _mm256_or_si256( bits, _mm256_and_si256( _mm256_xor_si256( x, r ), _mm256_xor_si256( y, r ) ) );
+            _mm256_storeu_si256( reinterpret_cast< __m256i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#elif defined( __SSE2__ )
+        __m128i y = _mm_set1_epi64x( k );
+        __m128i bits = _mm_setzero_si128();
+        for ( ; i + 2 <= n; i += 2 ) {
+            __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) );
+            __m128i r = _mm_add_epi64( x, y );
+            bits = _mm_or_si128( bits, _mm_and_si128( _mm_xor_si128( x, r ), _mm_xor_si128( y, r ) ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#endif
+        for ( ; i < n; i++ )
+            overflow |= __builtin_add_overflow( a[ i ], k, &out[ i ] );
+        return ! overflow;
+    }
+
+    /** a[ i ] - k, k may be the minimum, which has no negation. **/
+    inline bool sub_scalar( const i64* a, i64 k, i64* out, size_t n )
+    {
+        size_t i = 0;
+        bool overflow = false;
+#if defined( __AVX2__ )
+        __m256i y = _mm256_set1_epi64x( k );
+        __m256i bits = _mm256_setzero_si256();
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            __m256i r = _mm256_sub_epi64( x, y );
+            bits = _mm256_or_si256( bits, _mm256_and_si256( _mm256_xor_si256( x, y ), _mm256_xor_si256( x, r ) ) );
+            _mm256_storeu_si256( reinterpret_cast< __m256i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#elif defined( __SSE2__ )
+        __m128i y = _mm_set1_epi64x( k );
+        __m128i bits = _mm_setzero_si128();
+        for ( ; i + 2 <= n; i += 2 ) {
+            __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) );
+            __m128i r = _mm_sub_epi64( x, y );
+            bits = _mm_or_si128( bits, _mm_and_si128( _mm_xor_si128( x, y ), _mm_xor_si128( x, r ) ) );
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( out + i ), r );
+        }
+        overflow = ! none_negative( bits );
+#endif
+        for ( ; i < n; i++ )
+            overflow |= __builtin_sub_overflow( a[ i ], k, &out[ i ] );
+        return ! overflow;
+    }
+
+    inline bool mul_scalar( const i64* a, i64 k, i64* out, size_t n )
+    {
+        bool overflow = false;
+        for ( size_t i = 0; i < n; i++ )
+            overflow |= __builtin_mul_overflow( a[ i ], k, &out[ i ] );
+        return ! overflow;
+    }
+
+    /** False also if a partial sum of a lane overflows, while the total
+     *  fits, the caller then sums exactly. **/
+    inline bool sum( const i64* a, size_t n, i64& total )
+    {
+        size_t i = 0;
+        bool overflow = false;
+        total = 0;
+#if defined( __AVX2__ )
+        __m256i acc = _mm256_setzero_si256();
+        __m256i bits = _mm256_setzero_si256();
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            __m256i r = _mm256_add_epi64( acc, x );
+            bits = _mm256_or_si256( bits, _mm256_and_si256( _mm256_xor_si256( acc, r ), _mm256_xor_si256( x, r ) ) );
+            acc = r;
+        }
+        alignas( 32 ) i64 lanes[ 4 ];
+        _mm256_store_si256( reinterpret_cast< __m256i* >( lanes ), acc );
+        overflow = ! none_negative( bits );
+        for ( i64 l : lanes )
+            overflow |= __builtin_add_overflow( total, l, &total );
+#elif defined( __SSE2__ )
+        __m128i acc = _mm_setzero_si128();
+        __m128i bits = _mm_setzero_si128();
+        for ( ; i + 2 <= n; i += 2 ) {
+            __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) );
+            __m128i r = _mm_add_epi64( acc, x );
+            bits = _mm_or_si128( bits, _mm_and_si128( _mm_xor_si128( acc, r ), _mm_xor_si128( x, r ) ) );
+            acc = r;
+        }
+        alignas( 16 ) i64 lanes[ 2 ];
+        _mm_store_si128( reinterpret_cast< __m128i* >( lanes ), acc );
+        overflow = ! none_negative( bits );
+        for ( i64 l : lanes )
+            overflow |= __builtin_add_overflow( total, l, &total );
+#endif
+        for ( ; i < n; i++ )
+            overflow |= __builtin_add_overflow( total, a[ i ], &total );
+        return ! overflow;
+    }
+
+    /** Requires n > 0. **/
+    inline i64 min( const i64* a, size_t n )
+    {
+        size_t i = 0;
+        i64 result = std::numeric_limits< i64 >::max();
+#if defined( __AVX2__ )
+        __m256i acc = _mm256_set1_epi64x( result );
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            acc = _mm256_blendv_epi8( acc, x, _mm256_cmpgt_epi64( acc, x ) );
+        }
+        alignas( 32 ) i64 lanes[ 4 ];
+        _mm256_store_si256( reinterpret_cast< __m256i* >( lanes ), acc );
+        result = std::min( { lanes[ 0 ], lanes[ 1 ], lanes[ 2 ], lanes[ 3 ] } );
+#endif
+        for ( ; i < n; i++ )
+            result = std::min( result, a[ i ] );
+        return result;
+    }
+
+    /** Requires n > 0. **/
+    inline i64 max( const i64* a, size_t n )
+    {
+        size_t i = 0;
+        i64 result = std::numeric_limits< i64 >::min();
+#if defined( __AVX2__ )
+        __m256i acc = _mm256_set1_epi64x( result );
+        for ( ; i + 4 <= n; i += 4 ) {
+            __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( a + i ) );
+            acc = _mm256_blendv_epi8( acc, x, _mm256_cmpgt_epi64( x, acc ) );
+        }
+        alignas( 32 ) i64 lanes[ 4 ];
+        _mm256_store_si256( reinterpret_cast< __m256i* >( lanes ), acc );
+        result = std::max( { lanes[ 0 ], lanes[ 1 ], lanes[ 2 ], lanes[ 3 ] } );
+#endif
+        for ( ; i < n; i++ )
+            result = std::max( result, a[ i ] );
+        return result;
+    }
+
+    /** Four independent accumulators, so that the multiplications are not
+     *  serialized on a single dependency chain. False like sum. **/
+    inline bool dot( const i64* a, const i64* b, size_t n, i64& total )
+    {
+        size_t i = 0;
+        bool overflow = false;
+        i64 acc[ 4 ] = { 0, 0, 0, 0 };
+        for ( ; i + 4 <= n; i += 4 ) {
+            for ( int j = 0; j < 4; j++ ) {
+                i64 p;
+                overflow |= __builtin_mul_overflow( a[ i + j ], b[ i + j ], &p );
+                overflow |= __builtin_add_overflow( acc[ j ], p, &acc[ j ] );
+            }
+        }
+        total = 0;
+        for ( i64 l : acc )
+            overflow |= __builtin_add_overflow( total, l, &total );
+        for ( ; i < n; i++ ) {
+            i64 p;
+            overflow |= __builtin_mul_overflow( a[ i ], b[ i ], &p );
+            overflow |= __builtin_add_overflow( total, p, &total );
+        }
+        return ! overflow;
+    }
+
+    /** Inclusive prefix sums, out[ i ] = a[ 0 ] + ... + a[ i ]. The scan is
+     *  done in registers two lanes at a time, the carry is the last lane of
+     *  the previous block. The partial sum a[ i ] + a[ i + 1 ] of a block
+     *  may overflow, while the prefix sums fit, so a block with an overflow
+     *  is summed again by the checked scalar loop, before it is stored. **/
+    inline bool prefix_sum( const i64* a, i64* out, size_t n )
+    {
+        size_t i = 0;
+        i64 carry = 0;
+#if defined( __SSE2__ )
+        __m128i c = _mm_setzero_si128();
+        for ( ; i + 2 <= n; i += 2 ) {
+            __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) );
+            __m128i y = _mm_slli_si128( x, 8 );
+            __m128i s = _mm_add_epi64( x, y );
+            __m128i r = _mm_add_epi64( s, c );
+            __m128i bits = _mm_or_si128( _mm_and_si128( _mm_xor_si128( x, s ), _mm_xor_si128( y, s ) )
+                                       , _mm_and_si128( _mm_xor_si128( s, r ), _mm_xor_si128( c, r ) ) );
+            if ( ! none_negative( bits ) ) {
+                carry = _mm_cvtsi128_si64( c );
+                i64 first, second;
+                if ( __builtin_add_overflow( carry, a[ i ], &first )
+                  || __builtin_add_overflow( first, a[ i + 1 ], &second ) )
+                    return false;
+                r = _mm_set_epi64x( second, first );
+            }
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( out + i ), r );
+            c = _mm_unpackhi_epi64( r, r );
+        }
+        if ( i > 0 )
+            carry = out[ i - 1 ];
+#endif
+        for ( ; i < n; i++ ) {
+            if ( __builtin_add_overflow( carry, a[ i ], &carry ) )
+                return false;
+            out[ i ] = carry;
+        }
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Floating point
+    ///////////////////////////////////////////////////////////////////////////
+
+#if defined( __AVX2__ )
+    using vd = __m256d;
+    constexpr size_t vd_width = 4;
+    inline vd vd_load( const double* p ) { return _mm256_loadu_pd( p ); }
+    inline void vd_store( double* p, vd x ) { _mm256_storeu_pd( p, x ); }
+    inline vd vd_set( double k ) { return _mm256_set1_pd( k ); }
+    inline vd vd_add( vd x, vd y ) { return _mm256_add_pd( x, y ); }
+    inline vd vd_sub( vd x, vd y ) { return _mm256_sub_pd( x, y ); }
+    inline vd vd_mul( vd x, vd y ) { return _mm256_mul_pd( x, y ); }
+    inline vd vd_sqrt( vd x ) { return _mm256_sqrt_pd( x ); }
+#elif defined( __SSE2__ )
+    using vd = __m128d;
+    constexpr size_t vd_width = 2;
+    inline vd vd_load( const double* p ) { return _mm_loadu_pd( p ); }
+    inline void vd_store( double* p, vd x ) { _mm_storeu_pd( p, x ); }
+    inline vd vd_set( double k ) { return _mm_set1_pd( k ); }
+    inline vd vd_add( vd x, vd y ) { return _mm_add_pd( x, y ); }
+    inline vd vd_sub( vd x, vd y ) { return _mm_sub_pd( x, y ); }
+    inline vd vd_mul( vd x, vd y ) { return _mm_mul_pd( x, y ); }
+    inline vd vd_sqrt( vd x ) { return _mm_sqrt_pd( x ); }
+#endif
+
+    /** x * y + z, fused when the target has FMA. **/
+#if defined( __AVX2__ ) && defined( __FMA__ )
+    inline vd vd_fma( vd x, vd y, vd z ) { return _mm256_fmadd_pd( x, y, z ); }
+#elif defined( __SSE2__ )
+    inline vd vd_fma( vd x, vd y, vd z ) { return vd_add( vd_mul( x, y ), z ); }
+#endif
+
+    inline void add( const double* a, const double* b, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        for ( ; i + vd_width <= n; i += vd_width )
+            vd_store( out + i, vd_add( vd_load( a + i ), vd_load( b + i ) ) );
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = a[ i ] + b[ i ];
+    }
+
+    inline void sub( const double* a, const double* b, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        for ( ; i + vd_width <= n; i += vd_width )
+            vd_store( out + i, vd_sub( vd_load( a + i ), vd_load( b + i ) ) );
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = a[ i ] - b[ i ];
+    }
+
+    inline void mul( const double* a, const double* b, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        for ( ; i + vd_width <= n; i += vd_width )
+            vd_store( out + i, vd_mul( vd_load( a + i ), vd_load( b + i ) ) );
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = a[ i ] * b[ i ];
+    }
+
+    inline void add_scalar( const double* a, double k, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        vd y = vd_set( k );
+        for ( ; i + vd_width <= n; i += vd_width )
+            vd_store( out + i, vd_add( vd_load( a + i ), y ) );
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = a[ i ] + k;
+    }
+
+    inline void mul_scalar( const double* a, double k, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        vd y = vd_set( k );
+        for ( ; i + vd_width <= n; i += vd_width )
+            vd_store( out + i, vd_mul( vd_load( a + i ), y ) );
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = a[ i ] * k;
+    }
+
+    /** Correctly rounded, the same results as std::sqrt. **/
+    inline void sqrt( const double* a, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        for ( ; i + vd_width <= n; i += vd_width )
+            vd_store( out + i, vd_sqrt( vd_load( a + i ) ) );
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = std::sqrt( a[ i ] );
+    }
+
+    inline double sum( const double* a, size_t n )
+    {
+        size_t i = 0;
+        double total = 0;
+#if defined( __SSE2__ )
+        vd acc = vd_set( 0 );
+        for ( ; i + vd_width <= n; i += vd_width )
+            acc = vd_add( acc, vd_load( a + i ) );
+        double lanes[ vd_width ];
+        vd_store( lanes, acc );
+        for ( double l : lanes )
+            total += l;
+#endif
+        for ( ; i < n; i++ )
+            total += a[ i ];
+        return total;
+    }
+
+    /** Two vector accumulators hide the latency of the fused multiply-add,
+     *  the lanes are summed at the end, so the rounding differs from a
+     *  sequential loop. **/
+    inline double dot( const double* a, const double* b, size_t n )
+    {
+        size_t i = 0;
+        double total = 0;
+#if defined( __SSE2__ )
+        vd acc0 = vd_set( 0 ), acc1 = vd_set( 0 );
+        for ( ; i + 2 * vd_width <= n; i += 2 * vd_width ) {
+            acc0 = vd_fma( vd_load( a + i ), vd_load( b + i ), acc0 );
+            acc1 = vd_fma( vd_load( a + i + vd_width ), vd_load( b + i + vd_width ), acc1 );
+        }
+        double lanes[ vd_width ];
+        vd_store( lanes, vd_add( acc0, acc1 ) );
+        for ( double l : lanes )
+            total += l;
+#endif
+        for ( ; i < n; i++ )
+            total = std::fma( a[ i ], b[ i ], total );
+        return total;
+    }
+
+    /** exp( x ) = 2^k exp( r ) with k = round( x / ln 2 ), so |r| <= ln 2 / 2
+     *  and the Taylor polynomial of degree 13 is accurate to about an ulp.
+     *  The constant 1.5 * 2^52 rounds k and leaves it in the low bits of the
+     *  double, from where it is moved to the exponent field. Blocks, which
+     *  contain an argument outside of [ -708, 709 ] or a NaN, are computed
+     *  by std::exp, that handles the overflow and the subnormals. **/
+    struct exp_constants
+    {
+        static constexpr double log2e = 1.4426950408889634;
+        static constexpr double ln2_hi = 0.6931471803691238;
+        static constexpr double ln2_lo = 1.9082149292705877e-10;
+        static constexpr double round = 6755399441055744.0;
+        static constexpr double lower = -708.0;
+        static constexpr double upper = 709.0;
+        static constexpr int degree = 13;
+    };
+
+#if defined( __SSE2__ )
+    inline vd exp_vector( vd x )
+    {
+        using c = exp_constants;
+        vd t = vd_add( vd_mul( x, vd_set( c::log2e ) ), vd_set( c::round ) );
+        vd k = vd_sub( t, vd_set( c::round ) );
+        vd r = vd_sub( vd_sub( x, vd_mul( k, vd_set( c::ln2_hi ) ) ), vd_mul( k, vd_set( c::ln2_lo ) ) );
+
+        vd p = vd_set( 1 );
+        for ( int d = c::degree; d > 0; d-- )
+            p = vd_fma( p, vd_mul( r, vd_set( 1.0 / d ) ), vd_set( 1 ) );
+
+        double round = c::round;
+        i64 round_bits;
+        std::memcpy( &round_bits, &round, sizeof( round_bits ) );
+#if defined( __AVX2__ )
+        __m256i e = _mm256_sub_epi64( _mm256_castpd_si256( t ), _mm256_set1_epi64x( round_bits - 1023 ) );
+        vd scale = _mm256_castsi256_pd( _mm256_slli_epi64( e, 52 ) );
+#else
+        __m128i e = _mm_sub_epi64( _mm_castpd_si128( t ), _mm_set1_epi64x( round_bits - 1023 ) );
+        vd scale = _mm_castsi128_pd( _mm_slli_epi64( e, 52 ) );
+#endif
+        return vd_mul( p, scale );
+    }
+
+    inline bool exp_in_range( vd x )
+    {
+#if defined( __AVX2__ )
+        vd inside = _mm256_and_pd( _mm256_cmp_pd( x, vd_set( exp_constants::lower ), _CMP_GE_OQ )
+                                 , _mm256_cmp_pd( x, vd_set( exp_constants::upper ), _CMP_LE_OQ ) );
+        return _mm256_movemask_pd( inside ) == 0xf;
+#else
+        vd inside = _mm_and_pd( _mm_cmpge_pd( x, vd_set( exp_constants::lower ) )
+                              , _mm_cmple_pd( x, vd_set( exp_constants::upper ) ) );
+        return _mm_movemask_pd( inside ) == 0x3;
+#endif
+    }
+#endif
+
+    inline void exp( const double* a, double* out, size_t n )
+    {
+        size_t i = 0;
+#if defined( __SSE2__ )
+        for ( ; i + vd_width <= n; i += vd_width ) {
+            vd x = vd_load( a + i );
+            if ( exp_in_range( x ) )
+                vd_store( out + i, exp_vector( x ) );
+            else
+                for ( size_t j = i; j < i + vd_width; j++ )
+                    out[ j ] = std::exp( a[ j ] );
+        }
+#endif
+        for ( ; i < n; i++ )
+            out[ i ] = std::exp( a[ i ] );
+    }
+}
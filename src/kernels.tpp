@@ -0,0 +1,207 @@
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "kernels.hpp"
+
+using i64 = std::int64_t;
+
+/** Lengths around the vector widths, so that every tail is exercised. **/
+std::vector< i64 > sample( size_t n, i64 seed )
+{
+    std::vector< i64 > v;
+    for ( size_t i = 0; i < n; i++ )
+        v.push_back( ( seed * 7919 + i * 104729 ) % 1000 - 500 );
+    return v;
+}
+
+void test_elementwise()
+{
+    for ( size_t n = 0; n < 19; n++ ) {
+        auto a = sample( n, 1 );
+        auto b = sample( n, 2 );
+        std::vector< i64 > out( n );
+
+        kernels::add( a.data(), b.data(), out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] + b[ i ] );
+
+        kernels::sub( a.data(), b.data(), out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] - b[ i ] );
+
+        kernels::mul( a.data(), b.data(), out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] * b[ i ] );
+
+        kernels::add_scalar( a.data(), 42, out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] + 42 );
+
+        kernels::mul_scalar( a.data(), -3, out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] * -3 );
+    }
+}
+
+void test_reductions()
+{
+    for ( size_t n = 1; n < 19; n++ ) {
+        auto a = sample( n, 3 );
+        auto b = sample( n, 4 );
+
+        i64 sum = 0, dot = 0, min = a[ 0 ], max = a[ 0 ];
+        for ( size_t i = 0; i < n; i++ ) {
+            sum += a[ i ];
+            dot += a[ i ] * b[ i ];
+            min = std::min( min, a[ i ] );
+            max = std::max( max, a[ i ] );
+        }
+
+        i64 total;
+        assert( kernels::sum( a.data(), n, total ) && total == sum );
+        assert( kernels::dot( a.data(), b.data(), n, total ) && total == dot );
+        assert( kernels::min( a.data(), n ) == min );
+        assert( kernels::max( a.data(), n ) == max );
+    }
+    i64 total = 1;
+    assert( kernels::sum( static_cast< const i64* >( nullptr ), 0, total ) && total == 0 );
+}
+
+void test_prefix_sum()
+{
+    for ( size_t n = 0; n < 19; n++ ) {
+        auto a = sample( n, 5 );
+        std::vector< i64 > out( n );
+        assert( kernels::prefix_sum( a.data(), out.data(), n ) );
+        i64 acc = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            acc += a[ i ];
+            assert( out[ i ] == acc );
+        }
+    }
+}
+
+/** The overflow is put to every lane and to the tail in turn. **/
+void test_overflow()
+{
+    const i64 max = std::numeric_limits< i64 >::max();
+    const i64 min = std::numeric_limits< i64 >::min();
+    for ( size_t n = 1; n < 11; n++ ) {
+        for ( size_t at = 0; at < n; at++ ) {
+            std::vector< i64 > a = sample( n, 6 ), b = sample( n, 7 ), out( n );
+            a[ at ] = max - 1;
+            b[ at ] = 2;
+            assert( ! kernels::add( a.data(), b.data(), out.data(), n ) );
+            assert( ! kernels::mul( a.data(), b.data(), out.data(), n ) );
+            assert( ! kernels::add_scalar( a.data(), 2, out.data(), n ) );
+            assert( ! kernels::mul_scalar( a.data(), 2, out.data(), n ) );
+            b[ at ] = -2;
+            assert( ! kernels::sub( a.data(), b.data(), out.data(), n ) );
+            assert( kernels::add( a.data(), b.data(), out.data(), n ) && out[ at ] == max - 3 );
+
+            // the minimum has no negation
+            std::vector< i64 > negative( n, -1 );
+            assert( kernels::sub_scalar( negative.data(), min, out.data(), n ) && out[ at ] == max );
+            negative[ at ] = 0;
+            assert( ! kernels::sub_scalar( negative.data(), min, out.data(), n ) );
+
+            // the prefix sums fit, although two neighbours do not
+            std::vector< i64 > c( n, 0 );
+            c[ at ] = max;
+            if ( at + 1 < n )
+                c[ at + 1 ] = -max;
+            assert( kernels::prefix_sum( c.data(), out.data(), n ) && out[ at ] == max );
+            c[ at ] = min;
+            if ( at + 1 < n )
+                c[ at + 1 ] = -1;
+            assert( kernels::prefix_sum( c.data(), out.data(), n ) == ( at + 1 == n ) );
+
+            i64 total;
+            std::vector< i64 > d( n, 0 );
+            d[ at ] = max;
+            assert( kernels::sum( d.data(), n, total ) && total == max );
+            if ( n > 1 ) {
+                d[ ( at + 1 ) % n ] = 1;
+                assert( ! kernels::sum( d.data(), n, total ) );
+            }
+            assert( ! kernels::dot( d.data(), d.data(), n, total ) );
+        }
+    }
+}
+
+std::vector< double > sample_doubles( size_t n, double scale )
+{
+    std::vector< double > v;
+    for ( size_t i = 0; i < n; i++ )
+        v.push_back( scale * ( double( ( i * 7919 ) % 1000 ) / 500 - 1 ) );
+    return v;
+}
+
+bool close( double a, double b, double tolerance )
+{
+    return std::fabs( a - b ) <= tolerance * std::max( 1.0, std::fabs( b ) );
+}
+
+void test_floats()
+{
+    for ( size_t n = 0; n < 19; n++ ) {
+        auto a = sample_doubles( n, 3 );
+        auto b = sample_doubles( n + 1, 5 );
+        std::vector< double > out( n );
+
+        kernels::add( a.data(), b.data(), out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] + b[ i ] );
+
+        kernels::mul_scalar( a.data(), 0.5, out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( out[ i ] == a[ i ] * 0.5 );
+
+        double sum = 0, dot = 0;
+        for ( size_t i = 0; i < n; i++ ) {
+            sum += a[ i ];
+            dot += a[ i ] * b[ i ];
+        }
+        assert( close( kernels::sum( a.data(), n ), sum, 1e-12 ) );
+        assert( close( kernels::dot( a.data(), b.data(), n ), dot, 1e-12 ) );
+
+        // in place
+        kernels::sqrt( b.data(), b.data(), n );
+        kernels::sqrt( a.data(), out.data(), n );
+        for ( size_t i = 0; i < n; i++ )
+            assert( std::isnan( out[ i ] ) ? a[ i ] < 0 : out[ i ] == std::sqrt( a[ i ] ) );
+    }
+}
+
+void test_exp()
+{
+    auto a = sample_doubles( 1001, 700 );
+    std::vector< double > out( a.size() );
+    kernels::exp( a.data(), out.data(), a.size() );
+    for ( size_t i = 0; i < a.size(); i++ )
+        assert( std::fabs( out[ i ] - std::exp( a[ i ] ) ) <= 4e-16 * std::exp( a[ i ] ) );
+
+    double inf = std::numeric_limits< double >::infinity();
+    std::vector< double > special = { 0, 1, -1, 710, -746, inf, -inf, NAN, -720, 1e-300, 709, -708 };
+    out.resize( special.size() );
+    kernels::exp( special.data(), out.data(), special.size() );
+    for ( size_t i = 0; i < special.size(); i++ ) {
+        double expected = std::exp( special[ i ] );
+        assert( std::isnan( expected ) ? std::isnan( out[ i ] )
+                                       : out[ i ] == expected
+                                      || std::fabs( out[ i ] - expected ) <= 4e-16 * expected );
+    }
+}
+
+int main()
+{
+    test_elementwise();
+    test_reductions();
+    test_prefix_sum();
+    test_overflow();
+    test_floats();
+    test_exp();
+}
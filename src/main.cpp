@@ -8,38 +8,110 @@
 #include <fstream>
 #include <ios>
 #include <stdexcept>
+#include <thread>
 #include "parser.hpp"
 #include "builtins.hpp"
+#include "batch.hpp"
+#include "pipeline.hpp"
+#include "prelex.hpp"
+
+/** Sources of this size are lexed in parallel. **/
+const std::size_t parallel_lexing_size = 1 << 20;
 
 int main( int argc, char** argv )
 {
-    std::ifstream file( argv[ 1 ] );
-    parser< istream_generator< std::ifstream > > p( { std::move( file ) }, 10 );
+    std::vector< std::string > sources;
+    std::string profile_in;
+    std::string profile_out;
+    int threads = 0;
+    bool batch_mode = false;
+    bool timing = false;
+    int jobs = std::max( 1u, std::thread::hardware_concurrency() );
+
+    for ( int i = 1; i < argc; i++ ) {
+        std::string arg = argv[ i ];
+        if ( arg == "--load-profile" && i + 1 < argc )
+            profile_in = argv[ ++i ];
+        else if ( arg == "--save-profile" && i + 1 < argc )
+            profile_out = argv[ ++i ];
+        else if ( arg == "--parallel" && i + 1 < argc )
+            threads = std::stoi( argv[ ++i ] );
+        else if ( arg == "--timing" )
+            timing = true;
+        else if ( arg == "--batch" )
+            batch_mode = true;
+        else if ( arg == "--jobs" && i + 1 < argc )
+            jobs = std::stoi( argv[ ++i ] );
+        else
+            sources.push_back( arg );
+    }
+
+    // files and directories of scripts, a record per script on stdout
+    if ( batch_mode ) {
+        batch( sources ).run( jobs, std::cout );
+        return 0;
+    }
+
+    if ( sources.empty() ) {
+        std::cerr << "no source file" << std::endl;
+        return 1;
+    }
+
+    auto program = std::make_shared< eval::program_t >();
+    builtins< eval >::add_builtins( *program );
+    auto lexing = std::chrono::steady_clock::duration::zero();
+
+    auto run = [ & ]( auto& p ) {
+        add_operators( p );
+        try {
+            eval e( program );
 
-    p.op_table.insert( { "+",   { 6,    false } } );
-    p.op_table.insert( { "-",   { 6,    false } } );
-    p.op_table.insert( { "*",   { 7,    false } } );
-    p.op_table.insert( { "&&",  { 2,    false } } );
+            if ( ! profile_in.empty() ) {
+                std::ifstream profile( profile_in );
+                e.load_profile( profile );
+            }
 
-    eval e;
+            if ( threads > 0 )
+                e.enable_parallel( threads );
 
-    e.state._store.scopes.add_scope();
-    builtins< eval >::add_builtins( e );
-    e.state._store.scopes.add_scope();
+            // the items are evaluated while the following ones are parsed
+            parse_ahead< std::remove_reference_t< decltype( p ) > > items( p, 64 );
+            auto evaluating = std::chrono::steady_clock::duration::zero();
+            while ( auto item = items.next() ) {
+                auto start = std::chrono::steady_clock::now();
+                e.push( item );
+                e.run();
+                evaluating += std::chrono::steady_clock::now() - start;
+            }
+            TRACE( e.state._values );
+            if ( timing )
+                std::cerr << "lexing " << std::chrono::duration< double >( lexing ).count() << " s, "
+                          << items.timing << ", evaluating "
+                          << std::chrono::duration< double >( evaluating ).count() << " s" << std::endl;
+            if ( ! profile_out.empty() ) {
+                std::ofstream profile( profile_out );
+                e.save_profile( profile );
+            }
+        } catch( parsing_error &e ) {
+            TRACE( p.stack_trace );
+            std::cerr << e.what() << std::endl;
+        } catch( std::runtime_error e ) {
+            std::cerr << e.what() << std::endl;
+        }
+    };
 
+    // the source is lexed to a buffer first, large ones in chunks on the threads
     try {
-        auto printer = ast::ast_printer( pprint::PrettyPrinter( std::cout ) );
-        auto expr = p.p_expression();
-        // printer.accept( expr );
-        e.push( std::move( expr ) );
-        e.run();
-        TRACE( e.state._values );
-    } catch( parsing_error &e ) {
-        TRACE( p.stack_trace );
-        std::cerr << e.what() << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        mapped_file file( sources.back() );
+        bool chunked = file.size >= parallel_lexing_size && jobs > 1;
+        task_pool pool( chunked ? jobs - 1 : 0 );
+        parser< token_buffer > p( lex_parallel( file.view(), pool
+                                              , chunked ? file.size / ( 4 * jobs ) + 1 : file.size ), 10 );
+        lexing = std::chrono::steady_clock::now() - start;
+        run( p );
     } catch( std::runtime_error e ) {
         std::cerr << e.what() << std::endl;
+        return 1;
     }
-
-
 }
@@ -1,16 +1,21 @@
+#pragma once
+
 #include "kocky.hpp"
 #include "pprint.hpp"
 #include <cstdio>
+#include <cstdlib>
 #include <exception>
 #include <istream>
 #include <sstream>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <functional>
 #include <cctype>
+#include <algorithm>
 
 #include "ast.hpp"
 
@@ -76,6 +81,29 @@ struct string_generator
 
 };
 
+/** Characters of a view, which must outlive the generator. **/
+struct view_generator
+{
+    using value_t = int;
+
+    std::string_view content;
+    std::size_t counter = 0;
+
+    view_generator( std::string_view content ) : content( content ) {};
+
+    int next()
+    {
+        assert( !empty() );
+        return int( content[ counter++ ] );
+    }
+
+    int empty()
+    {
+        return counter >= content.size();
+    }
+
+};
+
 template < typename generator_t, typename metadata_t >
 struct parsing_state
 {
@@ -255,6 +283,8 @@ enum lex_type
     op,
 
     literal_number,
+    literal_float,
+    literal_string,
     literal_bool,
 
     sym_semicolon,
@@ -272,10 +302,14 @@ enum lex_type
 
     kw_fun,
     kw_let,
+    kw_rec,
+    kw_lazy,
     kw_in,
     kw_if,
     kw_then,
     kw_else,
+    kw_record,
+    kw_type,
 
     sp_newline,
     sp_eof
@@ -287,7 +321,11 @@ const std::map< std::string, lex_type > keywords = {
     { "then",   kw_then },
     { "fun",    kw_fun },
     { "let",    kw_let },
+    { "rec",    kw_rec },
+    { "lazy",   kw_lazy },
     { "in",    kw_in },
+    { "record", kw_record },
+    { "type",   kw_type },
     { "true",   literal_bool },
     { "false",  literal_bool },
     { "->",     sym_rarrow },
@@ -338,6 +376,7 @@ static int isspecial( int c ) {
         case '-':
         case '*':
         case '/':
+        case '%':
         case ':':
         case '=':
         case '<':
@@ -355,9 +394,23 @@ static int isspecial( int c ) {
 static int isidstart( int c ) { return std::isalpha( c ) || c == '_';  }
 static int isidchar( int c )  { return isidstart( c ) || std::isdigit( c ); }
 static int isopchar( int c )  { return isspecial( c ); }
+static int isexponent( int c ) { return c == 'e' || c == 'E'; }
+static int issign( int c )     { return c == '+' || c == '-'; }
 
 static std::string show_char( int c ) { return c == EOF ? "eof" : std::string{ char( c ) }; }
 
+/** The character of the escape \e in a string literal. **/
+static int string_escape( int e )
+{
+    switch ( e ) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case '"':
+        case '\\': return e;
+    }
+    throw parsing_error( "unknown escape: \\"s + show_char( e ) );
+}
+
 static std::string show_lexem( const lexeme& l )
 {
     std::stringstream ss;
@@ -371,11 +424,14 @@ struct row_col {
 
     int row = 0;
     int col = 0;
+    // the characters taken so far
+    std::size_t offset = 0;
 
     row_col( int newline ) : newline( newline ) {};
 
     void on_inc( int last )
     {
+        offset++;
         col++;
         if ( last == newline ) {
             row++;
@@ -393,6 +449,8 @@ struct lexer
     std::string buffer;
     int lex_row = 0;
     int lex_col = 0;
+    // the offset of the last lexeme in the source, but the end
+    std::size_t lex_offset = 0;
 
     lexer( generator_t g , int newline = '\n' )
          : p_state( std::move ( g )
@@ -405,12 +463,46 @@ struct lexer
         return { t, std::move( buffer ), lex_row, lex_col };
     }
 
-    lexeme get_lit_number()
+    void get_digits()
     {
-        buffer.push_back( p_state.req_pop( std::isdigit ) );
+        buffer.push_back( p_state.req_pop( std::isdigit, "digit" ) );
         while ( std::optional< int > c = p_state.match( std::isdigit ) )
             buffer.push_back( c.value() );
-        return flush_lex( literal_number );
+    }
+
+    /** Digits with an optional fraction and exponent, the number is a float
+     *  if it has either of them. **/
+    lexeme get_lit_number()
+    {
+        get_digits();
+        bool is_float = false;
+        if ( std::optional< int > c = p_state.match( '.' ) ) {
+            buffer.push_back( c.value() );
+            get_digits();
+            is_float = true;
+        }
+        if ( std::optional< int > c = p_state.match( isexponent ) ) {
+            buffer.push_back( c.value() );
+            if ( std::optional< int > sign = p_state.match( issign ) )
+                buffer.push_back( sign.value() );
+            get_digits();
+            is_float = true;
+        }
+        return flush_lex( is_float ? literal_float : literal_number );
+    }
+
+    /** Double quoted, with the escapes \n, \t, \" and \\. **/
+    lexeme get_lit_string()
+    {
+        p_state.req_pop( '"' );
+        while ( true ) {
+            int c = p_state.req_pop();
+            if ( c == '"' )
+                return flush_lex( literal_string );
+            if ( c == '\\' )
+                c = string_escape( p_state.req_pop() );
+            buffer.push_back( c );
+        }
     }
 
     lexeme flush_identifier( lex_type t )
@@ -458,8 +550,10 @@ struct lexer
 
         lex_row = p_state.meta.row;
         lex_col = p_state.meta.col;
+        lex_offset = p_state.meta.offset;
 
         if ( std::isdigit( c ) ) return get_lit_number();
+        if ( c == '"' )          return get_lit_string();
         if ( isidstart( c ) )    return get_identifier();
         if ( isopchar( c ) )     return get_operator();
 
@@ -487,9 +581,13 @@ struct lexer
 template < lex_type t >
 static int istype( const lexeme& l ) { return l.type == t; };
 static int isliteral( const lexeme& l ) { return l.type == literal_bool
-                                              || l.type == literal_number; };
+                                              || l.type == literal_number
+                                              || l.type == literal_float
+                                              || l.type == literal_string; };
 static int pat_start( const lexeme& l ) { return l.type == op && l.content == "<"; };
 static int pat_end( const lexeme& l ) { return l.type == op && l.content == ">"; };
+static int field_dot( const lexeme& l ) { return l.type == op && l.content == "."; };
+static int alternative( const lexeme& l ) { return l.type == op && l.content == "|"; };
 
 template < lex_type... ls >
 constexpr int isany( const lexeme& l ) {
@@ -510,21 +608,40 @@ struct meta_trace
     };
 };
 
+/** The generator gives the characters of the source, or its lexemes if it
+ *  was lexed already. **/
 template < typename generator_t >
 struct parser
 {
-    using p_state_t = parsing_state< lexer< generator_t >, meta_unit< lexeme > >;
+    using lexer_t = std::conditional_t< std::is_same_v< typename generator_t::value_t, lexeme >
+                                      , generator_t
+                                      , lexer< generator_t > >;
+    using p_state_t = parsing_state< lexer_t, meta_unit< lexeme > >;
 
     /** { name : ( prio, asoc ) } **/
     std::map< std::string, std::pair< int, bool > > op_table;
     int op_prio_depth = 0;
 
+    /** function definitions are numbered in the order of the source **/
+    int fundef_count = 0;
+
+    /** Records declared in the enclosing expressions, { name : fields } and
+     *  { field : { record : offset } }. A field name refers to every record
+     *  declaring it, the innermost one of a name shadows the others. **/
+    std::map< std::string, std::vector< std::string > > records;
+    std::map< std::string, std::map< std::string, int > > fields;
+
+    /** Declared constructors with their tags and arities, the tags are
+     *  numbered in the order of the source. **/
+    std::map< std::string, std::pair< type_tag, int > > constructors;
+    int constructor_count = 0;
+
     p_state_t p_state;
 
     std::stack< std::string > stack_trace;
 
     parser( generator_t generator, int op_prio_depth )
-        : p_state( lexer( std::move( generator ) )
+        : p_state( lexer_t( std::move( generator ) )
                  , meta_unit< lexeme >{}
                  , { sp_eof, "", -1, -1 }
                  , show_lexem )
@@ -559,18 +676,35 @@ struct parser
         return rpop( ast::variable( p_identifier() ) );
     }
 
-    int p_number() {
+    /** A number, which does not fit int_t, is read as a bigint. **/
+    std::variant< int_t, bigint > p_number() {
         tpush( "number" );
         lexeme l = p_state.req_pop( istype< literal_number > );
-        int content = 0;
+        int_t content = 0;
         for ( char c : l.content ) {
-            content *= 10;
-            content += c - '0';
+            if ( __builtin_mul_overflow( content, 10, &content )
+              || __builtin_add_overflow( content, c - '0', &content ) ) {
+                tpop();
+                return bigint::from_string( l.content );
+            }
         }
         tpop();
         return content;
     }
 
+    double p_float()
+    {
+        tpush( "float" );
+        lexeme l = p_state.req_pop( istype< literal_float > );
+        return rpop( std::strtod( l.content.c_str(), nullptr ) );
+    }
+
+    std::string p_string()
+    {
+        tpush( "string" );
+        return rpop( p_state.req_pop( istype< literal_string > ).content );
+    }
+
     bool p_bool()
     {
         tpush( "bool" );
@@ -583,10 +717,23 @@ struct parser
     {
         lexeme l = p_state.req_peek( isliteral, "literal" );
 
-        if ( l.type == literal_number )
-            return wrapper_t< int >{ p_number() };
+        if ( l.type == literal_number ) {
+            auto number = p_number();
+            if ( const int_t* small = std::get_if< int_t >( &number ) )
+                return wrapper_t< int_t >{ *small };
+            if constexpr ( std::is_same< R, ast::ast_node >::value )
+                return wrapper_t< bigint >{ std::get< bigint >( std::move( number ) ) };
+            throw parsing_error( "number " + l.content + " is out of range in a pattern" );
+        }
+        if ( l.type == literal_float )
+            return wrapper_t< double >{ p_float() };
         if ( l.type == literal_bool )
             return wrapper_t< bool >{ p_bool() };
+        if ( l.type == literal_string ) {
+            if constexpr ( std::is_same< R, ast::ast_node >::value )
+                return wrapper_t< std::string >{ p_string() };
+            throw parsing_error( "string " + l.content + " in a pattern, compare it instead" );
+        }
 
         assert( false );
     }
@@ -611,10 +758,10 @@ struct parser
             p_state.req_pop( istype< lpara > );
             ast::ast_node expr = p_expression();
             p_state.req_pop( istype< rpara > );
-            return rpop( std::move( expr ) );
+            return rpop( p_fields( std::move( expr ) ) );
         }
         if ( l.type == identifier )
-            return rpop( p_variable() );
+            return rpop( p_fields( p_variable() ) );
         if ( isliteral( l ) )
             return rpop( p_literal() );
         if ( istype< kw_fun >( l ) )
@@ -623,6 +770,23 @@ struct parser
         assert( false );
     }
 
+    /** Projections record.field following a variable or a parenthesized
+     *  expression, the offsets of the field are fixed here. **/
+    ast::ast_node p_fields( ast::ast_node record )
+    {
+        while ( p_state.match( field_dot ) ) {
+            tpush( "field" );
+            std::string field = p_identifier();
+            const auto& it = fields.find( field );
+            if ( it == fields.end() )
+                throw parsing_error( "field '" + field + "' is not declared" );
+            std::vector< std::pair< std::string, int > > offsets( it->second.begin(), it->second.end() );
+            record = ast::field_access{ ast::clone( std::move( record ) ), field, std::move( offsets ) };
+            tpop();
+        }
+        return record;
+    }
+
     ast::ast_node p_call()
     {
         tpush( "call" );
@@ -693,29 +857,191 @@ struct parser
         return rpop( std::move( acc ) );
     }
 
-    ast::ast_node p_letin()
+    /** let pattern := value in expression, the expression is missing in a
+     *  definition of the top level. **/
+    ast::ast_node p_letin( bool top_level = false )
     {
         tpush( "let in" );
         p_state.req_pop( istype< kw_let >, "let" );
+        bool recursive = p_state.match( istype< kw_rec > ).has_value();
+        bool lazy = ! recursive && p_state.match( istype< kw_lazy > ).has_value();
         ast::pattern pat = p_pattern();
+        if ( recursive && ! std::holds_alternative< ast::variable_pattern >( pat ) )
+            throw parsing_error( "let rec binds a single variable" );
+        if ( lazy && ! std::holds_alternative< ast::variable_pattern >( pat ) )
+            throw parsing_error( "let lazy binds a single variable" );
         p_state.req_pop( istype< sym_assign >, ":=" );
-        ast::ast_node value = p_expression();
+        ast::node_ptr value = ast::clone( p_expression() );
+        // the variable is bound before the value, only a function may use it
+        if ( recursive && ! std::holds_alternative< ast::function_def >( *value ) )
+            throw parsing_error( "let rec binds a function" );
+        // the variables of a definition are used by the following items, so
+        // none of their uses is the last one
+        if ( top_level && ! p_state.holds( istype< kw_in > ) )
+            return rpop( ast::let_in{ std::move( pat ), std::move( value ), nullptr, recursive, lazy } );
         p_state.req_pop( istype< kw_in >, "in" );
-        ast::ast_node expression = p_expression();
+        ast::node_ptr expression = ast::clone( p_expression() );
+
+        auto bound = ast::ast_free_vars::variables_in( pat );
+        if ( recursive )
+            ast::ast_last_uses::mark( bound, { value.get(), expression.get() } );
+        else
+            ast::ast_last_uses::mark( bound, { expression.get() } );
+
         return rpop( ast::let_in{ std::move( pat )
-                                , ast::clone( std::move( value ) )
-                                , ast::clone( std::move( expression ) ) } );
+                                , std::move( value )
+                                , std::move( expression )
+                                , recursive
+                                , lazy } );
+    }
+
+    ast::ast_node p_if()
+    {
+        tpush( "if then else" );
+        p_state.req_pop( istype< kw_if >, "if" );
+        ast::ast_node condition = p_expression();
+        p_state.req_pop( istype< kw_then >, "then" );
+        ast::ast_node then_branch = p_expression();
+        p_state.req_pop( istype< kw_else >, "else" );
+        ast::ast_node else_branch = p_expression();
+        return rpop( ast::if_then_else{ ast::clone( std::move( condition ) )
+                                      , ast::clone( std::move( then_branch ) )
+                                      , ast::clone( std::move( else_branch ) ) } );
+    }
+
+    ast::ast_node p_record( bool top_level = false )
+    {
+        tpush( "record" );
+        p_state.req_pop( istype< kw_record >, "record" );
+        std::string name = p_identifier();
+        p_state.req_pop( istype< sym_assign >, ":=" );
+        std::vector< std::string > names;
+        while ( p_state.holds( istype< identifier > ) ) {
+            std::string field = p_identifier();
+            if ( std::find( names.begin(), names.end(), field ) != names.end() )
+                throw parsing_error( "field '" + field + "' of " + name + " is declared twice" );
+            names.push_back( std::move( field ) );
+        }
+        if ( names.empty() )
+            throw parsing_error( "record " + name + " has no fields" );
+        bool definition = top_level && ! p_state.holds( istype< kw_in > );
+        if ( ! definition )
+            p_state.req_pop( istype< kw_in >, "in" );
+
+        // a record is a type with a single constructor
+        type_tag tag{ constructor_count, constructor_count, 1 };
+        constructor_count++;
+
+        auto outer_records = records;
+        auto outer_fields = fields;
+        auto outer_constructors = constructors;
+        for ( auto it = fields.begin(); it != fields.end(); ) {
+            it->second.erase( name );
+            it = it->second.empty() ? fields.erase( it ) : std::next( it );
+        }
+        records[ name ] = names;
+        for ( int i = 0; i < names.size(); i++ )
+            fields[ names[ i ] ][ name ] = i;
+        constructors[ name ] = { tag, int( names.size() ) };
+        // the declarations of a definition hold in the following items
+        if ( definition )
+            return rpop( ast::record_def{ std::move( name ), std::move( names ), nullptr, tag } );
+
+        ast::node_ptr expression = ast::clone( p_expression() );
+
+        records = std::move( outer_records );
+        fields = std::move( outer_fields );
+        constructors = std::move( outer_constructors );
+        return rpop( ast::record_def{ std::move( name ), std::move( names ), std::move( expression ), tag } );
+    }
+
+    /** type name := [ | ] C fields | ... in expression **/
+    ast::ast_node p_type( bool top_level = false )
+    {
+        tpush( "type" );
+        p_state.req_pop( istype< kw_type >, "type" );
+        std::string name = p_identifier();
+        p_state.req_pop( istype< sym_assign >, ":=" );
+        p_state.match( alternative );
+
+        std::vector< ast::constructor_def > declared;
+        do {
+            std::string constructor = p_identifier();
+            for ( const auto& c : declared )
+                if ( c.name == constructor )
+                    throw parsing_error( "constructor " + constructor + " is declared twice" );
+            std::vector< std::string > names;
+            while ( p_state.holds( istype< identifier > ) ) {
+                std::string field = p_identifier();
+                if ( std::find( names.begin(), names.end(), field ) != names.end() )
+                    throw parsing_error( "field '" + field + "' of " + constructor + " is declared twice" );
+                names.push_back( std::move( field ) );
+            }
+            declared.push_back( { std::move( constructor ), std::move( names ), {} } );
+        } while ( p_state.match( alternative ) );
+        bool definition = top_level && ! p_state.holds( istype< kw_in > );
+        if ( ! definition )
+            p_state.req_pop( istype< kw_in >, "in" );
+
+        int first = constructor_count;
+        constructor_count += declared.size();
+        auto outer_constructors = constructors;
+        for ( int i = 0; i < declared.size(); i++ ) {
+            declared[ i ].tag = { first + i, first, int( declared.size() ) };
+            constructors[ declared[ i ].name ] = { declared[ i ].tag, int( declared[ i ].fields.size() ) };
+        }
+        if ( definition )
+            return rpop( ast::type_def{ std::move( name ), std::move( declared ), nullptr } );
+
+        ast::node_ptr expression = ast::clone( p_expression() );
+
+        constructors = std::move( outer_constructors );
+        return rpop( ast::type_def{ std::move( name ), std::move( declared ), std::move( expression ) } );
+    }
+
+    /** The next item of a program, items are separated by semicolons. A
+     *  let, record or type without in is a definition, its bindings hold in
+     *  the following items. Null at the end of the source. **/
+    ast::node_ptr p_item()
+    {
+        tpush( "item" );
+        while ( p_state.match( istype< sym_semicolon > ) ) {}
+        if ( p_state.holds( istype< sp_eof > ) )
+            return rpop( ast::node_ptr() );
+
+        ast::ast_node item = p_state.holds( istype< kw_let > )    ? p_letin( true )
+                           : p_state.holds( istype< kw_record > ) ? p_record( true )
+                           : p_state.holds( istype< kw_type > )   ? p_type( true )
+                           : p_expression();
+        if ( ! p_state.holds( istype< sp_eof > ) )
+            p_state.req_pop( istype< sym_semicolon >, ";" );
+        return rpop( ast::clone( std::move( item ) ) );
     }
 
     ast::ast_node p_expression()
     {
         tpush( "expression" );
 
+        if ( p_state.holds( istype< kw_record > ) )
+        {
+            return rpop( p_record() );
+        }
+
+        if ( p_state.holds( istype< kw_type > ) )
+        {
+            return rpop( p_type() );
+        }
+
         if ( p_state.holds( istype< kw_let > ) )
         {
             return rpop( p_letin() );
         }
 
+        if ( p_state.holds( istype< kw_if > ) )
+        {
+            return rpop( p_if() );
+        }
+
         return rpop( p_expression( 0, false ) );
     }
 
@@ -736,10 +1062,53 @@ struct parser
         tpush( "object pattern" );
         p_state.req_pop( pat_start, "<" );
         std::string identifier = p_identifier();
+        if ( p_state.holds( field_dot ) )
+            return rpop( p_record_pattern( identifier ) );
         std::vector< ast::pattern > children;
         while ( ! p_state.match( pat_end ) )
             children.push_back( p_pattern() );
-        return rpop( ast::object_pattern{ identifier, std::move( children ) } );
+        type_tag tag = constructor_tag( identifier, children.size() );
+        return rpop( ast::object_pattern{ identifier, std::move( children ), tag } );
+    }
+
+    /** The tag of a declared constructor, whose arity is checked here. **/
+    type_tag constructor_tag( const std::string& name, int arity )
+    {
+        const auto& it = constructors.find( name );
+        if ( it == constructors.end() )
+            return {};
+        const auto& [ tag, declared_arity ] = it->second;
+        if ( arity != declared_arity )
+            throw parsing_error( "constructor " + name + " has " + std::to_string( declared_arity )
+                               + " fields but the pattern has " + std::to_string( arity ) );
+        return tag;
+    }
+
+    /** < Record .field pattern ... >, the fields which are not named are
+     *  matched by the wildcard, so only the named ones are bound. **/
+    ast::object_pattern p_record_pattern( const std::string& name )
+    {
+        tpush( "record pattern" );
+        const auto& it = records.find( name );
+        if ( it == records.end() )
+            throw parsing_error( "record " + name + " is not declared" );
+        const auto& names = it->second;
+
+        std::vector< ast::pattern > children( names.size(), ast::variable_pattern{ "_" } );
+        std::vector< bool > named( names.size(), false );
+        while ( ! p_state.match( pat_end ) ) {
+            p_state.req_pop( field_dot, "." );
+            std::string field = p_identifier();
+            int offset = std::find( names.begin(), names.end(), field ) - names.begin();
+            if ( offset == names.size() )
+                throw parsing_error( "record " + name + " has no field '" + field + "'" );
+            if ( named[ offset ] )
+                throw parsing_error( "field '" + field + "' is matched twice" );
+            named[ offset ] = true;
+            children[ offset ] = p_pattern();
+        }
+        type_tag tag = constructor_tag( name, names.size() );
+        return rpop( ast::object_pattern{ name, std::move( children ), tag } );
     }
 
     static int p_pattern_fch( const lexeme& l )
@@ -772,12 +1141,17 @@ struct parser
         tpop();
 
         tpush( "function path mapping - expression" );
-        ast::ast_node expr = p_expression();
+        ast::node_ptr expr = ast::clone( p_expression() );
         tpop();
 
+        ast::ast_free_vars::id_set_t bound;
+        for ( const auto& p : patterns )
+            ast::ast_free_vars::_variables_in( p, bound );
+        ast::ast_last_uses::mark( bound, { expr.get() } );
+
         return rpop( ast::function_path{ std::move( patterns )
                                        , ast::variable_pattern{ "_" }
-                                       , ast::clone( expr ) } );
+                                       , std::move( expr ) } );
     }
 
     ast::function_path p_funpath()
@@ -791,6 +1165,7 @@ struct parser
     {
         tpush( "function definition" );
         p_state.req_pop( istype< kw_fun > );
+        int id = fundef_count++;
 
         std::vector< std::shared_ptr< const ast::function_path > > paths;
 
@@ -815,7 +1190,7 @@ struct parser
         if ( paths.empty() )
             throw parsing_error( "there are no function paths" );
 
-        return rpop( ast::function_def{ std::move( paths ), arity } );
+        return rpop( ast::function_def{ std::move( paths ), arity, id } );
     }
 
 };
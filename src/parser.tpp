@@ -57,6 +57,42 @@ void test_lex_small() {
     assert( l.empty() );
 }
 
+void test_lex_numbers() {
+    lexer_str l( "12 1.5 2e10 0.25E-3 7"s );
+    std::vector< lexeme > test_case = {
+        { literal_number, "12", 0, 0 },
+        { literal_float, "1.5", 0, 3 },
+        { literal_float, "2e10", 0, 7 },
+        { literal_float, "0.25E-3", 0, 12 },
+        { literal_number, "7", 0, 20 }
+    };
+
+    for ( const auto& x : test_case )
+        assert( x == l.next() );
+    assert( l.empty() );
+
+    lexer_str bad( "1.x"s );
+    bool failed = false;
+    try {
+        bad.next();
+    } catch ( parsing_error& e ) {
+        failed = true;
+    }
+    assert( failed );
+}
+
+void test_lex_strings() {
+    lexer_str l( "\"a b\" \"tab\\t\\\"q\\\"\" x"s );
+    std::vector< lexeme > test_case = {
+        { literal_string, "a b", 0, 0 },
+        { literal_string, "tab\t\"q\"", 0, 6 },
+        { identifier, "x", 0, 19 }
+    };
+
+    for ( const auto& x : test_case )
+        assert( x == l.next() );
+    assert( l.empty() );
+}
 
 // TODO: parsing testing
 void sandbox()
@@ -83,5 +119,7 @@ int main()
 {
     test_lex_basic();
     test_lex_small();
+    test_lex_numbers();
+    test_lex_strings();
     sandbox();
 }
@@ -18,7 +18,8 @@ template< typename value_t >
 struct literal_pattern;
 
 using pattern = std::variant< variable_pattern
-                            , literal_pattern< int >
+                            , literal_pattern< int_t >
+                            , literal_pattern< double >
                             , literal_pattern< bool >
                             , object_pattern >;
 
@@ -41,15 +42,32 @@ struct literal_pattern {
         , value ( value ) {}
 };
 
+/** Integer literals in C++ code stand for Int patterns. **/
+literal_pattern( identifier_t, int ) -> literal_pattern< int_t >;
+
+/** Tag of a constructor of a declared type. The constructors of one type
+ *  have consecutive tags first, ..., first + count - 1, objects and
+ *  patterns of undeclared constructors have the tag -1. **/
+struct type_tag {
+
+    int tag = -1;
+    int first = 0;
+    int count = 0;
+
+    bool declared() const { return tag >= 0; }
+};
+
 struct object_pattern {
 
     identifier_t name;
     std::vector< pattern > patterns;
+    type_tag tag;
 
     object_pattern
         ( identifier_t name
-        , std::vector< pattern > patterns )
-        : name( std::move( name ) ), patterns( std::move( patterns ) ) {}
+        , std::vector< pattern > patterns
+        , type_tag tag = {} )
+        : name( std::move( name ) ), patterns( std::move( patterns ) ), tag( tag ) {}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -179,3 +197,77 @@ static bool contains( const pattern& p, const pattern& q )
                 }, q ); }
             , p );
 };
+
+///////////////////////////////////////////////////////////////////////////////
+// Overlap of patterns
+///////////////////////////////////////////////////////////////////////////////
+
+/** Two patterns overlap if there is an object matched by both of them. Unlike
+ *  contains, this is symmetric; patterns which do not overlap can be tried in
+ *  any order. **/
+static bool overlaps( const pattern& p, const pattern& q );
+
+template< typename T >
+static bool overlaps( const variable_pattern& a, const T& b )
+{
+    return true;
+}
+
+template< typename T >
+static bool overlaps( const literal_pattern< T >& a, const variable_pattern& b )
+{
+    return true;
+}
+
+static bool overlaps( const object_pattern& a, const variable_pattern& b )
+{
+    return true;
+}
+
+template< typename P, typename Q >
+static bool overlaps( const literal_pattern< P >& a, const literal_pattern< Q >& b )
+{
+    return false;
+}
+
+template< typename T >
+static bool overlaps( const literal_pattern< T >& a, const literal_pattern< T >& b )
+{
+    return a.name == b.name
+        && a.value == b.value;
+}
+
+template< typename T >
+static bool overlaps( const literal_pattern< T >& a, const object_pattern& b )
+{
+    return a.name == b.name
+        && b.patterns.size() == 1
+        && overlaps( pattern( a ), b.patterns[ 0 ] );
+}
+
+template< typename T >
+static bool overlaps( const object_pattern& a, const literal_pattern< T >& b )
+{
+    return overlaps( b, a );
+}
+
+static bool overlaps( const object_pattern& a, const object_pattern& b )
+{
+    if ( a.name != b.name || a.patterns.size() != b.patterns.size() )
+        return false;
+    for ( int i = 0; i < a.patterns.size(); i++ )
+        if ( ! overlaps( a.patterns[ i ], b.patterns[ i ] ) )
+            return false;
+    return true;
+}
+
+static bool overlaps( const pattern& p, const pattern& q )
+{
+    return std::visit(
+        [&]( auto &l ){
+            return std::visit(
+                [&]( auto &r ){
+                    return overlaps( l, r );
+                }, q ); }
+            , p );
+};
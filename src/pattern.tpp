@@ -28,7 +28,30 @@ void test_contains()
     assert( ! contains( int_a, bool_a ) );
 }
 
+void test_overlaps()
+{
+    literal_pattern int_3 = literal_pattern( "Int", 3 );
+    literal_pattern int_6 = literal_pattern( "Int", 6 );
+    variable_pattern a = variable_pattern( "a" );
+    object_pattern int_a = object_pattern( "Int", { a } );
+    object_pattern bool_a = object_pattern( "Bool", { a } );
+    object_pattern point_3_a = object_pattern( "Point", { int_3, a } );
+    object_pattern point_a_6 = object_pattern( "Point", { a, int_6 } );
+    object_pattern point_6_a = object_pattern( "Point", { int_6, a } );
+
+    assert( overlaps( a, int_3 ) );
+    assert( overlaps( int_3, a ) );
+    assert( overlaps( int_a, int_3 ) );
+    assert( overlaps( int_3, int_a ) );
+    assert( ! overlaps( int_3, int_6 ) );
+    assert( ! overlaps( bool_a, int_3 ) );
+    assert( ! overlaps( bool_a, int_a ) );
+    assert( overlaps( point_3_a, point_a_6 ) );
+    assert( ! overlaps( point_3_a, point_6_a ) );
+}
+
 int main()
 {
     test_contains();
+    test_overlaps();
 }
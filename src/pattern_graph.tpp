@@ -18,8 +18,8 @@ void test_pattern_graph()
     object_pattern wrapper_a = object_pattern( "Wrapper", { a } );
     object_pattern wrapper_wr_a = object_pattern( "Wrapper", { wrapper_a } );
 
-    literal_pattern< int > p3 = literal_pattern< int >( "Int", 3 );
-    literal_pattern< int > p6 = literal_pattern< int >( "Int", 4 );
+    literal_pattern< int_t > p3 = literal_pattern< int_t >( "Int", 3 );
+    literal_pattern< int_t > p6 = literal_pattern< int_t >( "Int", 4 );
 
     g.add_edge( meter_a, mile_b,      "meters_to_miles" );
     g.add_edge( mile_b,  meter_a,     "miles_to_meters" );
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <utility>
+
+#include "ast.hpp"
+#include "parser.hpp"
+
+/** The items of a program parsed ahead on a thread of their own. At most
+ *  capacity parsed items wait for the evaluator, so the evaluation starts
+ *  with the first item and parsing is hidden behind it. **/
+template < typename parser_t >
+struct parse_ahead
+{
+    using clock = std::chrono::steady_clock;
+
+    struct timing_t
+    {
+        long items = 0;
+        // spent by the parsing thread
+        clock::duration parsing{};
+        // spent by the consumer waiting for the items
+        clock::duration waiting{};
+
+        friend std::ostream& operator <<( std::ostream& os, const timing_t& t )
+        {
+            using seconds = std::chrono::duration< double >;
+            return os << t.items << " items, parsing " << seconds( t.parsing ).count()
+                      << " s, waiting for items " << seconds( t.waiting ).count() << " s";
+        }
+    };
+
+    parser_t& parser;
+    const std::size_t capacity;
+    timing_t timing;
+
+    std::deque< ast::node_ptr > items;
+    bool finished = false;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread producer;
+
+    /** The parser is used by the thread until the end of the source. **/
+    parse_ahead( parser_t& p, std::size_t capacity )
+        : parser( p )
+        , capacity( capacity )
+        , producer( [ this ]{ produce(); } ) {}
+
+    parse_ahead( const parse_ahead& ) = delete;
+    parse_ahead& operator =( const parse_ahead& ) = delete;
+
+    ~parse_ahead()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            finished = true;
+        }
+        changed.notify_all();
+        producer.join();
+    }
+
+    /** The next item, null at the end of the source. A parsing error is
+     *  thrown once the items before it were taken. **/
+    ast::node_ptr next()
+    {
+        auto start = clock::now();
+        std::unique_lock< std::mutex > lock( mutex );
+        changed.wait( lock, [ this ]{ return ! items.empty() || finished; } );
+        timing.waiting += clock::now() - start;
+
+        if ( items.empty() ) {
+            if ( error )
+                std::rethrow_exception( std::exchange( error, nullptr ) );
+            return nullptr;
+        }
+        ast::node_ptr item = std::move( items.front() );
+        items.pop_front();
+        timing.items++;
+        lock.unlock();
+        changed.notify_all();
+        return item;
+    }
+
+private:
+    void produce()
+    {
+        try {
+            while ( true ) {
+                auto start = clock::now();
+                ast::node_ptr item = parser.p_item();
+                timing.parsing += clock::now() - start;
+
+                std::unique_lock< std::mutex > lock( mutex );
+                if ( ! item || finished )
+                    break;
+                changed.wait( lock, [ this ]{ return items.size() < capacity || finished; } );
+                items.push_back( std::move( item ) );
+                lock.unlock();
+                changed.notify_all();
+            }
+        } catch ( ... ) {
+            std::lock_guard< std::mutex > lock( mutex );
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            finished = true;
+        }
+        changed.notify_all();
+    }
+};
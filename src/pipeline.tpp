@@ -0,0 +1,89 @@
+#include <cassert>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "pipeline.hpp"
+
+std::vector< std::string > run_items( std::string source, std::size_t capacity )
+{
+    auto program = std::make_shared< eval::program_t >();
+    builtins< eval >::add_builtins( *program );
+
+    parser_str p( { source }, 10 );
+    add_operators( p );
+    parse_ahead< parser_str > items( p, capacity );
+
+    eval e( program );
+    std::vector< std::string > values;
+    while ( auto item = items.next() ) {
+        e.push( item );
+        e.run();
+        if ( e.state._values.size() > values.size() )
+            values.push_back( e.state._values.top().to_string() );
+    }
+    assert( items.timing.items == 10 );
+    return values;
+}
+
+void test_definitions()
+{
+    std::string source =
+        "let rec fib := fun |- 0 -> 0 |- 1 -> 1 |- n -> fib ( n - 1 ) + fib ( n - 2 ) ;"
+        "let k := 3 ;"
+        "let lazy unused := ( fun |- 0 -> 0 ) 1 ;"
+        "type Shape := Circle r | Square a ;"
+        "record P := x y ;"
+        "fib 10 ;"
+        "( fun |- < Square a > -> a * k * ( P k 7 ).y ) ( Square 1 ) ;"
+        ";;"
+        "let k := k + 1 ;"
+        "let x := k in x * k ;"
+        "k";
+    for ( std::size_t capacity : { 1, 64 } ) {
+        auto values = run_items( source, capacity );
+        assert( ( values == std::vector< std::string >{ "( Int 55 )", "( Int 21 )", "( Int 16 )", "( Int 4 )" } ) );
+    }
+}
+
+void test_parse_error()
+{
+    parser_str p( { "1 ; 2 ; let x := in 3" }, 10 );
+    add_operators( p );
+    parse_ahead< parser_str > items( p, 1 );
+
+    // the items before the error are evaluated first
+    assert( items.next() && items.next() );
+    bool thrown = false;
+    try {
+        items.next();
+    } catch ( parsing_error& ) {
+        thrown = true;
+    }
+    assert( thrown );
+    assert( ! items.next() );
+
+    std::stringstream out;
+    out << items.timing;
+    assert( out.str().find( "2 items" ) == 0 );
+}
+
+void test_abandoned()
+{
+    // the parsing thread stops when the items are no longer taken
+    std::string source;
+    for ( int i = 0; i < 1000; i++ )
+        source += std::to_string( i ) + " ; ";
+    parser_str p( { source }, 10 );
+    add_operators( p );
+    parse_ahead< parser_str > items( p, 4 );
+    assert( items.next() );
+}
+
+int main()
+{
+    test_definitions();
+    test_parse_error();
+    test_abandoned();
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Work-stealing pool of worker threads. Every worker has its own deque, it
+ *  runs its newest task first and steals the oldest task of another worker
+ *  once it has none. Tasks submitted from other threads go to the shared
+ *  queue. A thread waiting for a task runs other tasks meanwhile, see
+ *  help_until, so tasks may wait for their subtasks. **/
+struct task_pool
+{
+    using task_t = std::function< void() >;
+
+    struct queue_t
+    {
+        std::mutex mutex;
+        std::deque< task_t > tasks;
+        // statistics of the thread owning the queue
+        std::atomic< long > executed{ 0 };
+        std::atomic< long > stolen{ 0 };
+    };
+
+    // queues[ 0 ] is shared, queues[ i + 1 ] belongs to the i-th worker
+    std::vector< std::unique_ptr< queue_t > > queues;
+    std::vector< std::thread > workers;
+
+    std::atomic< bool > stopping{ false };
+    std::atomic< int > queued{ 0 };
+    std::atomic< int > idle{ 0 };
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    /** The pool and the queue of the worker running on this thread. **/
+    static inline thread_local task_pool* current_pool = nullptr;
+    static inline thread_local int current_queue = 0;
+
+    explicit task_pool( int threads )
+    {
+        for ( int i = 0; i <= threads; i++ )
+            queues.push_back( std::make_unique< queue_t >() );
+        for ( int i = 0; i < threads; i++ )
+            workers.emplace_back( [ this, i ]{ work( i + 1 ); } );
+    }
+
+    task_pool( const task_pool& ) = delete;
+    task_pool& operator =( const task_pool& ) = delete;
+
+    ~task_pool()
+    {
+        {
+            std::lock_guard< std::mutex > lock( sleep_mutex );
+            stopping = true;
+        }
+        wake.notify_all();
+        for ( auto& w : workers )
+            w.join();
+    }
+
+    int size() const { return workers.size(); }
+
+    /** Every idle worker has a queued task waiting for it, new work is
+     *  better done inline. **/
+    bool saturated() const
+    {
+        return queued.load( std::memory_order_relaxed ) >= idle.load( std::memory_order_relaxed );
+    }
+
+    void submit( task_t task )
+    {
+        queue_t& q = *queues[ current_pool == this ? current_queue : 0 ];
+        queued++;
+        {
+            std::lock_guard< std::mutex > lock( q.mutex );
+            q.tasks.push_back( std::move( task ) );
+        }
+        wake.notify_one();
+    }
+
+    /** Runs a task of the own queue or a stolen one, false if there is
+     *  none. **/
+    bool run_one()
+    {
+        int self = current_pool == this ? current_queue : 0;
+        task_t task;
+        if ( ! pop( *queues[ self ], task, true ) ) {
+            bool found = false;
+            for ( int i = 1; i <= queues.size() && ! found; i++ )
+                found = pop( *queues[ ( self + i ) % queues.size() ], task, false );
+            if ( ! found )
+                return false;
+            queues[ self ]->stolen++;
+        }
+        queues[ self ]->executed++;
+        queued--;
+        task();
+        finished.notify_all();
+        return true;
+    }
+
+    /** Runs other tasks until done, or sleeps until a task finishes. **/
+    template < typename pred_t >
+    void help_until( pred_t done )
+    {
+        while ( ! done() ) {
+            if ( run_one() )
+                continue;
+            std::unique_lock< std::mutex > lock( sleep_mutex );
+            finished.wait_for( lock, std::chrono::microseconds( 100 ), [ & ]{
+                return done() || queued > 0; } );
+        }
+    }
+
+private:
+    static bool pop( queue_t& q, task_t& task, bool newest )
+    {
+        std::lock_guard< std::mutex > lock( q.mutex );
+        if ( q.tasks.empty() )
+            return false;
+        if ( newest ) {
+            task = std::move( q.tasks.back() );
+            q.tasks.pop_back();
+        } else {
+            task = std::move( q.tasks.front() );
+            q.tasks.pop_front();
+        }
+        return true;
+    }
+
+    void work( int queue )
+    {
+        current_pool = this;
+        current_queue = queue;
+        idle++;
+        while ( ! stopping ) {
+            if ( queued > 0 ) {
+                idle--;
+                bool ran = run_one();
+                idle++;
+                if ( ran )
+                    continue;
+            }
+            std::unique_lock< std::mutex > lock( sleep_mutex );
+            wake.wait_for( lock, std::chrono::milliseconds( 1 ), [ this ]{
+                return stopping || queued > 0; } );
+        }
+        idle--;
+    }
+};
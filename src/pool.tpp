@@ -0,0 +1,57 @@
+#include <cassert>
+#include <atomic>
+#include <memory>
+
+#include "pool.hpp"
+
+/** Sums 1 .. n by splitting the range into tasks, which wait for their
+ *  subtasks. **/
+long split_sum( task_pool& pool, long from, long to )
+{
+    if ( to - from < 64 ) {
+        long sum = 0;
+        for ( long i = from; i < to; i++ )
+            sum += i;
+        return sum;
+    }
+    long mid = from + ( to - from ) / 2;
+    auto done = std::make_shared< std::atomic< bool > >( false );
+    auto left = std::make_shared< long >( 0 );
+    pool.submit( [ &pool, from, mid, done, left ]{
+        *left = split_sum( pool, from, mid );
+        done->store( true, std::memory_order_release );
+    } );
+    long right = split_sum( pool, mid, to );
+    pool.help_until( [ & ]{ return done->load( std::memory_order_acquire ); } );
+    return *left + right;
+}
+
+void test_nested()
+{
+    for ( int threads : { 1, 3, 8 } ) {
+        task_pool pool( threads );
+        assert( pool.size() == threads );
+        assert( split_sum( pool, 0, 100000 ) == 4999950000l );
+    }
+}
+
+void test_many()
+{
+    task_pool pool( 4 );
+    std::atomic< int > count{ 0 };
+    for ( int i = 0; i < 10000; i++ )
+        pool.submit( [ & ]{ count++; } );
+    pool.help_until( [ & ]{ return count == 10000; } );
+    assert( pool.queued == 0 );
+
+    long executed = 0;
+    for ( const auto& q : pool.queues )
+        executed += q->executed;
+    assert( executed == 10000 );
+}
+
+int main()
+{
+    test_nested();
+    test_many();
+}
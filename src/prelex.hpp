@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parser.hpp"
+#include "pool.hpp"
+
+/** A file mapped to the memory for reading. Pipes, terminals and other
+ *  files, which are not regular, cannot be mapped and have no size, they
+ *  are read to a buffer instead. **/
+struct mapped_file
+{
+    const char* data = nullptr;
+    std::size_t size = 0;
+    bool mapped = false;
+    std::string buffer;
+
+    explicit mapped_file( const std::string& path )
+    {
+        int fd = ::open( path.c_str(), O_RDONLY );
+        struct stat st;
+        if ( fd < 0 || ::fstat( fd, &st ) < 0 ) {
+            if ( fd >= 0 )
+                ::close( fd );
+            throw std::runtime_error( "cannot open " + path );
+        }
+        if ( ! S_ISREG( st.st_mode ) ) {
+            read_all( fd, path );
+            ::close( fd );
+            return;
+        }
+        size = st.st_size;
+        if ( size > 0 ) {
+            void* region = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( region == MAP_FAILED ) {
+                ::close( fd );
+                throw std::runtime_error( "cannot map " + path );
+            }
+            ::madvise( region, size, MADV_SEQUENTIAL );
+            data = static_cast< const char* >( region );
+            mapped = true;
+        }
+        ::close( fd );
+    }
+
+    mapped_file( const mapped_file& ) = delete;
+    mapped_file& operator =( const mapped_file& ) = delete;
+
+    ~mapped_file()
+    {
+        if ( mapped )
+            ::munmap( const_cast< char* >( data ), size );
+    }
+
+    std::string_view view() const { return { data, size }; }
+
+private:
+    void read_all( int fd, const std::string& path )
+    {
+        char chunk[ 1 << 16 ];
+        for ( ;; ) {
+            ssize_t n = ::read( fd, chunk, sizeof chunk );
+            if ( n < 0 && errno == EINTR )
+                continue;
+            if ( n < 0 ) {
+                ::close( fd );
+                throw std::runtime_error( "cannot read " + path );
+            }
+            if ( n == 0 )
+                break;
+            buffer.append( chunk, n );
+        }
+        data = buffer.data();
+        size = buffer.size();
+    }
+};
+
+/** Lexemes of a source lexed ahead, a generator for the parser. They are
+ *  kept in arrays of their types, offsets and lengths in the source, which
+ *  must outlive the buffer. The row and the column of a lexeme are found in
+ *  the table of the offsets where the lines start, only once the lexeme is
+ *  taken or its position asked. The error of the lexer is thrown once the
+ *  lexemes before it were taken, as if the source was lexed on demand. **/
+struct token_buffer
+{
+    using value_t = lexeme;
+
+    std::string_view source;
+    std::vector< std::uint8_t > types;
+    std::vector< std::uint32_t > offsets;
+    std::vector< std::uint32_t > lengths;
+    // line_starts[ 0 ] is 0, a line starts after every newline
+    std::vector< std::uint32_t > line_starts{ 0 };
+    std::exception_ptr error;
+
+    std::size_t position = 0;
+    // the line of the last lexeme taken, the lexemes are taken in order
+    std::size_t line = 0;
+
+    std::size_t size() const { return types.size(); }
+
+    void push( lex_type type, std::size_t offset, std::size_t length )
+    {
+        types.push_back( type );
+        offsets.push_back( offset );
+        lengths.push_back( length );
+    }
+
+    /** The row and the column of the i-th lexeme. **/
+    std::pair< int, int > position_of( std::size_t i ) const
+    {
+        auto it = std::upper_bound( line_starts.begin(), line_starts.end(), offsets[ i ] );
+        return { int( it - line_starts.begin() - 1 ), int( offsets[ i ] - *std::prev( it ) ) };
+    }
+
+    std::string content( std::size_t i ) const
+    {
+        std::string_view text = source.substr( offsets[ i ], lengths[ i ] );
+        if ( types[ i ] != literal_string )
+            return std::string( text );
+
+        std::string unescaped;
+        for ( std::size_t j = 1; j + 1 < text.size(); j++ ) {
+            char c = text[ j ];
+            if ( c == '\\' )
+                c = string_escape( text[ ++j ] );
+            unescaped.push_back( c );
+        }
+        return unescaped;
+    }
+
+    lexeme next()
+    {
+        if ( position == size() )
+            std::rethrow_exception( std::exchange( error, nullptr ) );
+        std::size_t i = position++;
+        while ( line + 1 < line_starts.size() && line_starts[ line + 1 ] <= offsets[ i ] )
+            line++;
+        return { lex_type( types[ i ] ), content( i ), int( line ), int( offsets[ i ] - line_starts[ line ] ) };
+    }
+
+    int empty()
+    {
+        return position >= size() && ! error;
+    }
+};
+
+/** Lexes the source from begin by the lexer to the buffer, the lexemes are
+ *  kept by their offsets, without the row and the column, until the end of
+ *  the source or until stop( end of the last lexeme ) holds. Returns the
+ *  end of the last lexeme. Throws the error of the lexer. **/
+template < typename stop_t >
+std::size_t scan( std::string_view source, std::size_t begin, std::size_t end
+                , token_buffer& out, stop_t stop )
+{
+    lexer< view_generator > l( view_generator( source.substr( begin, end - begin ) ) );
+    std::size_t last = out.size() ? out.offsets.back() : 0;
+    while ( ! l.empty() ) {
+        lex_type type = l.next().type;
+        std::size_t taken = begin + l.p_state.meta.offset;
+        if ( type == sp_eof ) {
+            // like the lexer, the end after whitespace is a lexeme at the last one
+            out.push( sp_eof, last, 0 );
+            return taken;
+        }
+        last = begin + l.lex_offset;
+        out.push( type, last, taken - last );
+        if ( stop( taken ) )
+            return taken;
+    }
+    return end;
+}
+
+inline std::size_t scan( std::string_view source, std::size_t begin, std::size_t end, token_buffer& out )
+{
+    return scan( source, begin, end, out, []( std::size_t ){ return false; } );
+}
+
+/** Lexes the source in chunks on the pool, the result equals the lexemes
+ *  of the sequential lexer. The chunks start at whitespace, a chunk lexed
+ *  from its start to its end without an error leaves the lexer between
+ *  two lexemes, so the lexemes of the next one are the lexemes of the
+ *  source. A chunk ending inside a string or failing otherwise is lexed
+ *  again, until the lexer is between two lexemes at the start of a later
+ *  chunk, whose lexemes are taken from there on. The newlines of the
+ *  chunks are found meanwhile, for the positions of the lexemes. **/
+inline token_buffer lex_parallel( std::string_view source, task_pool& pool
+                                , std::size_t chunk_size, int newline = '\n' )
+{
+    if ( source.size() >= std::numeric_limits< std::uint32_t >::max() )
+        throw std::runtime_error( "the source is too large" );
+
+    struct chunk_t
+    {
+        std::size_t begin, end;
+        token_buffer tokens;
+        std::exception_ptr error;
+        std::vector< std::uint32_t > line_starts;
+        std::atomic< bool > done{ false };
+    };
+
+    std::vector< std::unique_ptr< chunk_t > > chunks;
+    std::size_t begin = 0;
+    while ( begin < source.size() ) {
+        std::size_t end = std::min( source.size(), begin + std::max< std::size_t >( chunk_size, 1 ) );
+        while ( end < source.size() && ! std::isspace( source[ end ] ) )
+            end++;
+        chunks.push_back( std::make_unique< chunk_t >() );
+        chunks.back()->begin = begin;
+        chunks.back()->end = end;
+        begin = end;
+    }
+
+    for ( auto& c : chunks )
+        pool.submit( [ &, c = c.get() ]{
+            try {
+                scan( source, c->begin, c->end, c->tokens );
+            } catch ( ... ) {
+                c->error = std::current_exception();
+            }
+            const char* data = source.data();
+            for ( const char* p = data + c->begin;
+                  ( p = static_cast< const char* >( std::memchr( p, newline, data + c->end - p ) ) ); )
+                c->line_starts.push_back( ++p - data );
+            c->done.store( true, std::memory_order_release );
+        } );
+    for ( auto& c : chunks )
+        pool.help_until( [ & ]{ return c->done.load( std::memory_order_acquire ); } );
+
+    token_buffer result;
+    result.source = source;
+    for ( auto& c : chunks )
+        result.line_starts.insert( result.line_starts.end(), c->line_starts.begin(), c->line_starts.end() );
+
+    // the chunk from k on, which starts in the whitespace after a lexeme
+    // ending at taken, so between two lexemes of the source, if there is one
+    auto synchronized = [ & ]( std::size_t k, std::size_t taken ) {
+        while ( k < chunks.size() && chunks[ k ]->begin < taken )
+            k++;
+        if ( k == chunks.size() )
+            return k;
+        for ( std::size_t i = taken; i < chunks[ k ]->begin; i++ )
+            if ( ! std::isspace( source[ i ] ) )
+                return chunks.size();
+        return k;
+    };
+
+    for ( std::size_t k = 0; k < chunks.size(); ) {
+        auto& c = chunks[ k ];
+        auto& t = c->tokens;
+        // the end of a chunk is not the end of the source
+        std::size_t n = t.size() - ( c->end < source.size() && t.size() && t.types.back() == sp_eof );
+        result.types.insert( result.types.end(), t.types.begin(), t.types.begin() + n );
+        result.offsets.insert( result.offsets.end(), t.offsets.begin(), t.offsets.begin() + n );
+        result.lengths.insert( result.lengths.end(), t.lengths.begin(), t.lengths.begin() + n );
+        if ( ! c->error ) {
+            k++;
+            continue;
+        }
+
+        // the lexemes before the error are kept, the rest is lexed again
+        std::size_t from = n ? t.offsets.back() + t.lengths.back() : c->begin;
+        std::size_t next = chunks.size();
+        try {
+            scan( source, from, source.size(), result, [ & ]( std::size_t taken ) {
+                next = synchronized( k + 1, taken );
+                return next < chunks.size();
+            } );
+        } catch ( ... ) {
+            result.error = std::current_exception();
+            break;
+        }
+        k = next;
+    }
+
+    // the end of the source is reported at the last lexeme, like the lexer does
+    std::size_t n = result.size();
+    if ( n && result.types.back() == sp_eof )
+        result.offsets.back() = n > 1 ? result.offsets[ n - 2 ] : 0;
+    return result;
+}
@@ -0,0 +1,116 @@
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "prelex.hpp"
+
+struct lexed_t
+{
+    std::vector< lexeme > tokens;
+    std::string error;
+};
+
+lexed_t lex_sequential( const std::string& source )
+{
+    lexed_t result;
+    lexer_str l( source );
+    try {
+        while ( ! l.empty() )
+            result.tokens.push_back( l.next() );
+    } catch ( parsing_error& e ) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+lexed_t drain( token_buffer ls )
+{
+    lexed_t result;
+    try {
+        while ( ! ls.empty() )
+            result.tokens.push_back( ls.next() );
+    } catch ( parsing_error& e ) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+void check( const std::string& source, task_pool& pool )
+{
+    lexed_t expected = lex_sequential( source );
+    for ( std::size_t chunk : { 1, 2, 3, 7, 16, 1000 } ) {
+        lexed_t got = drain( lex_parallel( source, pool, chunk ) );
+        assert( got.tokens == expected.tokens );
+        assert( got.error == expected.error );
+    }
+}
+
+void test_same_lexemes()
+{
+    task_pool pool( 3 );
+    for ( std::string source : {
+            "", "   ", "a", "\n\n  x \n", "let x := 12 in x + 1.5e3 ;\n  f ( y ) ;\n\n z",
+            "f := fun a b -> ( a + b );\n g := fun c d -> a + b;\n",
+            // whitespace inside strings is not a boundary
+            "\"a b  c\" \"\n x \n\" \"tab\\t \\\" q\" y\n  \"\"  z",
+            "x \" unterminated  string",
+            "a b # c d",
+            "1.  x",
+            "\"bad \\q escape\" y z", "1e", "2E+ x", "1.x", "\"a\\", "x\n\t;; ( ] ->\n" } )
+        check( source, pool );
+}
+
+void test_large()
+{
+    std::string source;
+    for ( int i = 0; i < 2000; i++ )
+        source += "let v" + std::to_string( i ) + " := [ " + std::to_string( i * 7 ) + " , "
+                + std::to_string( i ) + ".25 , \"item " + std::to_string( i ) + "\" ] ;\n"
+                + ( i % 3 ? "  " : "\t\n" );
+    task_pool pool( 3 );
+    lexed_t expected = lex_sequential( source );
+    for ( std::size_t chunk : { 100, 4096, 1 << 16 } )
+        assert( drain( lex_parallel( source, pool, chunk ) ).tokens == expected.tokens );
+
+    // the positions are found without taking the lexemes
+    token_buffer buffer = lex_parallel( source, pool, 4096 );
+    for ( std::size_t i = 0; i < buffer.size(); i++ )
+        assert( buffer.position_of( i ) == std::make_pair( expected.tokens[ i ].row, expected.tokens[ i ].col ) );
+
+    // without workers the chunks are lexed by the waiting thread
+    task_pool none( 0 );
+    assert( drain( lex_parallel( source, none, 512 ) ).tokens == expected.tokens );
+}
+
+void test_parse()
+{
+    task_pool pool( 2 );
+    parser< token_buffer > p( lex_parallel( "let x := 4 in\n x * x + 1", pool, 3 ), 10 );
+    p.op_table.insert( { "+"s, { 6, false } } );
+    p.op_table.insert( { "*"s, { 7, false } } );
+    p.p_expression();
+    assert( p.p_state.empty() );
+}
+
+void test_pipe()
+{
+    // a pipe has no size, it is read instead of mapped
+    int fds[ 2 ];
+    assert( ::pipe( fds ) == 0 );
+    std::string source = "let x := 4 in x * x";
+    assert( ::write( fds[ 1 ], source.data(), source.size() ) == source.size() );
+    ::close( fds[ 1 ] );
+    {
+        mapped_file file( "/dev/fd/" + std::to_string( fds[ 0 ] ) );
+        assert( file.view() == source );
+    }
+    ::close( fds[ 0 ] );
+}
+
+int main()
+{
+    test_same_lexemes();
+    test_large();
+    test_parse();
+    test_pipe();
+}
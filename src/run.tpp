@@ -31,7 +31,639 @@ void test_run()
     assert( e.state._values.top() == object_t( false ) );
 }
 
+/** The ids of the functions start at first_id, the expressions of a
+ *  program need distinct ids for their dispatch profiles. **/
+ast::node_ptr parse( std::string source, int first_id = 0 )
+{
+    parser_str p( { source }, 10 );
+    p.fundef_count = first_id;
+
+    p.op_table.insert( { "+"s, { 6, false } } );
+    p.op_table.insert( { "-"s, { 6, false } } );
+    p.op_table.insert( { "*"s, { 7, false } } );
+    p.op_table.insert( { "/"s, { 7, false } } );
+    p.op_table.insert( { "%"s, { 7, false } } );
+    p.op_table.insert( { "++"s, { 5, false } } );
+    p.op_table.insert( { "&&"s, { 2, false } } );
+    p.op_table.insert( { "||"s, { 1, false } } );
+    return std::make_shared< ast::ast_node >( p.p_expression() );
+}
+
+eval::object_t run_source( std::string source, int threads = 0 )
+{
+    eval e;
+    if ( threads > 0 )
+        e.enable_parallel( threads );
+
+    e.state._store.scopes.add_scope();
+    builtins< eval >::add_builtins( e );
+    e.state._store.scopes.add_scope();
+
+    e.push( parse( source ) );
+    e.run();
+
+    assert( e.state._values.size() == 1 );
+    return e.state._values.top();
+}
+
+/** Whether the source fails with an error_t, whose message contains the
+ *  expected text. **/
+template < typename error_t = std::runtime_error >
+bool throws( const std::string& source, const std::string& expected = "", int threads = 0 )
+{
+    try {
+        run_source( source, threads );
+    } catch ( error_t& e ) {
+        return std::string( e.what() ).find( expected ) != std::string::npos;
+    }
+    return false;
+}
+
+void test_if_then_else()
+{
+    using object_t = eval::object_t;
+
+    assert( run_source( "if true then 1 else 2" ) == object_t( 1 ) );
+    assert( run_source( "if false then 1 else 2" ) == object_t( 2 ) );
+    assert( run_source( "let x := 3 in if true && true then x + 1 else x" ) == object_t( 4 ) );
+    assert( run_source( "( fun |- b < Int n > -> if b then n else 0 - n ) false 5" ) == object_t( -5 ) );
+
+    assert( throws( "if 1 then 1 else 2" ) );
+}
+
+void test_short_circuit()
+{
+    using object_t = eval::object_t;
+
+    // the right operand would fail to match
+    std::string fail = "( ( fun |- 0 -> true ) 1 )";
+
+    assert( run_source( "false && " + fail ) == object_t( false ) );
+    assert( run_source( "true || " + fail ) == object_t( true ) );
+    assert( run_source( "true && false || true" ) == object_t( true ) );
+    assert( run_source( "__bool_and__ false " + fail ) == object_t( false ) );
+    assert( run_source( "__bool_or__ true " + fail ) == object_t( true ) );
+    assert( run_source( "let x := false in __bool_or__ false x" ) == object_t( false ) );
+
+    // the right operand is checked, when it is the result
+    for ( std::string bad : { "true && 5", "false || 5", "__bool_and__ true 5", "let x := 5 in __bool_or__ false x" } )
+        assert( throws( bad, "is not a Bool" ) );
+}
+
+void test_let_rec()
+{
+    using object_t = eval::object_t;
+
+    assert( run_source( "let rec fact := fun |- 0 -> 1 |- n -> n * fact ( n - 1 ) "
+                        "in fact 5" ) == object_t( 120 ) );
+    assert( run_source( "let rec even := fun |- 0 -> true "
+                        "                    |- n -> if even ( n - 1 ) then false else true "
+                        "in even 7" ) == object_t( false ) );
+
+    // shadowing does not overwrite the captured variable
+    assert( run_source( "let x := 1 in let g := fun a -> x in let x := 2 in g 0" ) == object_t( 1 ) );
+    assert( run_source( "let rec f := fun |- 0 -> 0 |- n -> f ( n - 1 ) "
+                        "in let f := f 3 in f" ) == object_t( 0 ) );
+
+    // the variable is bound before its value, only a function may use it
+    assert( throws< parsing_error >( "let rec x := x + 1 in x", "let rec binds a function" ) );
+}
+
+void test_let_lazy()
+{
+    using object_t = eval::object_t;
+
+    // the value would fail to match, but it is never used
+    assert( run_source( "let lazy x := ( fun |- 0 -> 0 ) 1 in 5" ) == object_t( 5 ) );
+    assert( run_source( "let lazy x := 2 * 3 in x + x" ) == object_t( 12 ) );
+    assert( run_source( "let y := 4 in let lazy x := y + 1 in "
+                        "let f := fun a -> a + x in f 1 + f 2" ) == object_t( 13 ) );
+
+    parser_str p( { "let lazy x := __trace__ 7 in x + x" }, 10 );
+    p.op_table.insert( { "+"s, { 6, false } } );
+
+    eval e;
+    e.state._store.scopes.add_scope();
+    builtins< eval >::add_builtins( e );
+    e.state._store.scopes.add_scope();
+    e.push( p.p_expression() );
+
+    // the thunk is overwritten by its value after the first use
+    int forced = 0;
+    while ( ! e.state._cells.empty() ) {
+        if ( std::holds_alternative< thunk_update< eval > >( e.state.cells_top() ) )
+            forced++;
+        e.run_top();
+    }
+    assert( forced == 1 );
+    assert( e.state._values.top() == object_t( 14 ) );
+}
+
+void test_streams()
+{
+    using object_t = eval::object_t;
+
+    std::string sum = "fold ( fun a x -> a + x ) 0 ";
+    std::string odd = "( fun |- < Int n > -> ( fun |- 0 -> false |- _ -> true ) ( n % 2 ) ) ";
+    std::string naturals = "( unfold ( fun n -> Cons n ( n + 1 ) ) 0 ) ";
+
+    assert( run_source( sum + "( range 0 10 )" ) == object_t( 45 ) );
+    assert( run_source( sum + "( take 5 " + naturals + ")" ) == object_t( 10 ) );
+    assert( run_source( sum + "( take 3 ( filter " + odd + naturals + ") )" ) == object_t( 9 ) );
+    assert( run_source( sum + "( map ( fun x -> x * x ) ( range 1 4 ) )" ) == object_t( 14 ) );
+    assert( run_source( "( fun |- < Cons x xs > -> x ) ( uncons ( range 7 9 ) )" ) == object_t( 7 ) );
+    assert( run_source( "( fun |- < Nil > -> 0 ) ( uncons ( range 9 9 ) )" ) == object_t( 0 ) );
+    assert( throws( sum + "( take 3 ( filter ( fun x -> 1 ) ( range 0 10 ) ) )", "predicate result is not a Bool" ) );
+
+    // the pipeline runs in constant memory, the closures made for the elements
+    // do not keep their slots once they are gone
+    std::string pipeline = "( map ( fun x -> x * 2 ) ( range 0 20000 ) )";
+    for ( auto [ source, expected ] : { std::pair( sum + pipeline, 399980000 )
+                                      , std::pair( "fold ( fun a x -> a + ( fun y -> y + x ) 1 ) 0 " + pipeline, 400000000 ) } ) {
+        parser_str p( { source }, 10 );
+        p.op_table.insert( { "+"s, { 6, false } } );
+        p.op_table.insert( { "*"s, { 7, false } } );
+
+        eval e;
+        e.state._store.scopes.add_scope();
+        builtins< eval >::add_builtins( e );
+        e.state._store.scopes.add_scope();
+        e.push( p.p_expression() );
+
+        size_t max_store = 0;
+        size_t max_cells = 0;
+        while ( ! e.state._cells.empty() ) {
+            e.run_top();
+            max_store = std::max( max_store, e.state._store._store.size() );
+            max_cells = std::max( max_cells, e.state._cells.size() );
+        }
+        assert( e.state._values.top() == object_t( expected ) );
+        assert( max_store < 100 );
+        assert( max_cells < 100 );
+    }
+}
+
+void test_arrays()
+{
+    using object_t = eval::object_t;
+
+    std::string xs = "( array_range 0 10 )";
+
+    assert( run_source( "array_sum " + xs ) == object_t( 45 ) );
+    assert( run_source( "array_length ( array_slice " + xs + " 2 7 )" ) == object_t( 5 ) );
+    assert( run_source( "array_get ( array_slice " + xs + " 2 7 ) 1" ) == object_t( 3 ) );
+    assert( run_source( "array_sum ( array_map __int_mul__ " + xs + " 2 )" ) == object_t( 90 ) );
+    assert( run_source( "array_dot " + xs + " " + xs ) == object_t( 285 ) );
+    assert( run_source( "array_max ( array_zip __int_sub__ ( array_make 10 3 ) " + xs + " )" ) == object_t( 3 ) );
+    assert( run_source( "array_min ( array_zip __int_sub__ ( array_make 10 3 ) " + xs + " )" ) == object_t( -6 ) );
+    assert( run_source( "array_get ( array_scan " + xs + " ) 9" ) == object_t( 45 ) );
+    assert( run_source( "array_sum ( array_from ( map ( fun x -> x * x ) ( range 0 4 ) ) )" ) == object_t( 14 ) );
+
+    assert( throws( "array_get " + xs + " 10" ) );
+
+    // the reductions are promoted, the elements stay machine integers
+    std::string max = "9223372036854775807", min = "( 0 - " + max + " - 1 )";
+    assert( run_source( "array_sum ( array_make 2 " + max + " )" )
+            == object_t( bigint::from_string( "18446744073709551614" ) ) );
+    assert( run_source( "array_sum ( array_set ( array_make 9 " + max + " ) 8 " + min + " )" )
+            == object_t( bigint::from_string( "64563604257983430648" ) ) );
+    assert( run_source( "array_sum ( array_set ( array_make 2 " + max + " ) 1 " + min + " )" ) == object_t( -1 ) );
+    assert( run_source( "array_dot ( array_make 3 " + max + " ) ( array_make 3 2 )" )
+            == object_t( bigint::from_string( "55340232221128654842" ) ) );
+    for ( std::string bad : { "array_map __int_sub__ ( array_make 3 0 ) " + min
+                            , "array_map __int_add__ ( array_make 5 " + max + " ) 1"
+                            , "array_zip __int_mul__ ( array_make 5 " + max + " ) ( array_make 5 2 )"
+                            , "array_scan ( array_make 3 " + max + " )" } )
+        assert( throws( bad, "an element of the array is out of range" ) );
+}
+
+void test_in_place()
+{
+    using object_t = eval::object_t;
+    using int_array_t = eval::types::int_array_t;
+
+    // a is used again, array_set has to copy
+    assert( run_source( "let a := array_make 3 0 in let b := array_set a 0 7 in "
+                        "array_sum a + array_sum b" ) == object_t( 7 ) );
+    assert( run_source( "let a := array_range 0 4 in array_sum ( array_zip __int_add__ a a )" )
+            == object_t( 12 ) );
+    assert( run_source( "let rec fill := fun |- a 0 -> a "
+                        "                   |- a i -> fill ( array_set a i i ) ( i - 1 ) in "
+                        "array_sum ( fill ( array_make 100 0 ) 99 )" ) == object_t( 4950 ) );
+
+    parser_str p( { "array_scan ( array_set xs 0 5 )" }, 10 );
+    ast::ast_node expr = p.p_expression();
+    ast::ast_last_uses::mark( { "xs" }, { &expr } );
+
+    eval e;
+    e.state._store.scopes.add_scope();
+    builtins< eval >::add_builtins( e );
+    e.state._store.scopes.add_scope();
+
+    const std::int64_t* buffer;
+    {
+        int_array_t xs( std::vector< std::int64_t >( 4, 1 ) );
+        buffer = xs.data();
+        e.state._store.bind( "xs", object_t( std::move( xs ) ) );
+    }
+
+    e.push( expr );
+    e.run();
+
+    int_array_t result = e.state._values.top().get_value< int_array_t >();
+    assert( result.data() == buffer );
+    assert( result == int_array_t( { 5, 6, 7, 8 } ) );
+}
+
+void test_maps()
+{
+    using object_t = eval::object_t;
+
+    std::string squares = "( ( let rec fill := fun |- m 0 -> m "
+                          "                         |- m n -> fill ( map_insert m n ( n * n ) ) ( n - 1 ) "
+                          "    in fill ) map_empty 100 )";
+
+    assert( run_source( "map_size " + squares ) == object_t( 100 ) );
+    assert( run_source( "( fun |- < Some x > -> x ) ( map_lookup " + squares + " 7 )" ) == object_t( 49 ) );
+    assert( run_source( "( fun |- < None > -> 0 ) ( map_lookup " + squares + " 0 )" ) == object_t( 0 ) );
+    assert( run_source( "map_size ( map_remove " + squares + " 7 )" ) == object_t( 99 ) );
+    assert( run_source( "map_fold ( fun a k v -> a + v ) 0 " + squares ) == object_t( 338350 ) );
+
+    // structured keys, the map is persistent
+    assert( run_source( "let m := map_insert map_empty ( Cons 1 Nil ) 1 in "
+                        "let n := map_insert m ( Cons 1 Nil ) 2 in "
+                        "( fun |- < Some x > < Some y > -> x * 10 + y ) "
+                        "  ( map_lookup m ( Cons 1 Nil ) ) ( map_lookup n ( Cons 1 Nil ) )" )
+            == object_t( 12 ) );
+}
+
+void test_big_ints()
+{
+    using object_t = eval::object_t;
+
+    std::string fact = "let rec fact := fun |- 0 -> 1 |- n -> n * fact ( n - 1 ) in ";
+
+    assert( run_source( fact + "fact 20" ) == object_t( int_t( 2432902008176640000 ) ) );
+    assert( run_source( fact + "fact 25" )
+            == object_t( bigint::from_string( "15511210043330985984000000" ) ) );
+    assert( run_source( fact + "fact 25 / fact 23" ) == object_t( 600 ) );
+    assert( run_source( "9223372036854775807 + 1 - 1" ) == object_t( INT64_MAX ) );
+    assert( run_source( "0 - 9223372036854775808" ) == object_t( INT64_MIN ) );
+    assert( run_source( "100000000000000000000 % 7" ) == object_t( 2 ) );
+
+    // a literal pattern does not match a big Int
+    assert( run_source( "( fun |- 0 -> 1 |- n -> 2 ) ( 18446744073709551616 * 0 + 18446744073709551616 )" )
+            == object_t( 2 ) );
+
+    assert( throws( "1 / 0" ) );
+}
+
+void test_floats()
+{
+    using object_t = eval::object_t;
+
+    assert( run_source( "1.5 + 2.25" ) == object_t( 3.75 ) );
+    assert( run_source( "1 + 0.5" ) == object_t( 1.5 ) );
+    assert( run_source( "7.0 / 2" ) == object_t( 3.5 ) );
+    assert( run_source( "7 / 2" ) == object_t( 3 ) );
+    assert( run_source( "2e3 - 1" ) == object_t( 1999.0 ) );
+    assert( run_source( "truncate ( sqrt 10.0 )" ) == object_t( 3 ) );
+    assert( run_source( "float 18446744073709551616 / 2" ) == object_t( 9223372036854775808.0 ) );
+    assert( run_source( "( fun |- 0.5 -> 1 |- < Float x > -> 2 |- x -> 3 ) 0.5" ) == object_t( 1 ) );
+    assert( run_source( "( fun |- 0.5 -> 1 |- < Float x > -> 2 |- x -> 3 ) 1.5" ) == object_t( 2 ) );
+    assert( run_source( "( fun |- 0.5 -> 1 |- < Float x > -> 2 |- x -> 3 ) 1" ) == object_t( 3 ) );
+
+    std::string xs = "( farray_of ( array_range 0 10 ) )";
+    assert( run_source( "farray_sum " + xs ) == object_t( 45.0 ) );
+    assert( run_source( "farray_dot " + xs + " " + xs ) == object_t( 285.0 ) );
+    assert( run_source( "farray_get ( farray_sqrt ( farray_map __int_mul__ " + xs + " 4 ) ) 9" )
+            == object_t( 6.0 ) );
+    assert( run_source( "farray_get ( farray_exp ( farray_make 3 0.0 ) ) 2" ) == object_t( 1.0 ) );
+    assert( run_source( "farray_sum ( farray_zip __int_sub__ " + xs + " ( farray_make 10 1.5 ) )" )
+            == object_t( 30.0 ) );
+
+    assert( throws( "1 + true" ) );
+    for ( std::string bad : { "farray_map __int_mul__ ( farray_make 2 1.0 ) true"
+                            , "farray_map __int_add__ ( farray_make 2 1.0 ) \"a\"" } )
+        assert( throws( bad, "expected Int or Float but got" ) );
+}
+
+void test_strings()
+{
+    using object_t = eval::object_t;
+
+    assert( run_source( "\"hello\" ++ \", \" ++ \"world\"" ) == object_t( text( "hello, world" ) ) );
+    assert( run_source( "string_length \"tab\\there\"" ) == object_t( 8 ) );
+    assert( run_source( "string_slice \"squid\" 1 3" ) == object_t( text( "qu" ) ) );
+    assert( run_source( "string_char \"A\" 0" ) == object_t( 65 ) );
+    assert( run_source( "string_compare \"abc\" \"abd\"" ) == object_t( -1 ) );
+    assert( run_source( "show 42 ++ \" \" ++ show 1.5" ) == object_t( text( "42 1.5" ) ) );
+
+    // a report built by repeated concatenation
+    assert( run_source( "let rec report := fun |- s 0 -> s "
+                        "                      |- s n -> report ( s ++ show n ++ \";\" ) ( n - 1 ) in "
+                        "string_length ( report \"\" 10000 )" ) == object_t( 38894 + 10000 ) );
+
+    // strings as map keys
+    assert( run_source( "( fun |- < Some x > -> x ) "
+                        "( map_lookup ( map_insert map_empty ( \"k\" ++ \"ey\" ) 1 ) \"key\" )" )
+            == object_t( 1 ) );
+}
+
+void test_records()
+{
+    using object_t = eval::object_t;
+
+    std::string point = "record Point := x y z in ";
+    assert( run_source( point + "( Point 1 2 3 ).y" ) == object_t( 2 ) );
+    assert( run_source( point + "let p := Point 1 2 3 in p.x + p.z" ) == object_t( 4 ) );
+    assert( run_source( point + "( fun |- < Point .z c .x a > -> a * 10 + c ) ( Point 1 2 3 )" ) == object_t( 13 ) );
+    assert( run_source( point + "( fun |- < Point .y 2 > -> true |- _ -> false ) ( Point 1 5 3 )" ) == object_t( false ) );
+
+    // nested projections, an inner declaration shadows the field
+    assert( run_source( point + "record Line := from to in "
+                                "let l := Line ( Point 1 2 3 ) ( Point 4 5 6 ) in l.to.y - l.from.x" )
+            == object_t( 4 ) );
+    assert( run_source( point + "record Pixel := x in ( Pixel 7 ).x" ) == object_t( 7 ) );
+
+    // a field of several records is found by the record of the object
+    std::string shared = "record P := x y in record Q := y z in ";
+    assert( run_source( shared + "let p := P 1 2 in p.y" ) == object_t( 2 ) );
+    assert( run_source( shared + "let q := Q 3 4 in q.y" ) == object_t( 3 ) );
+    assert( run_source( "record Pixel := x in let p := Pixel 1 in record Point := x y in p.x" ) == object_t( 1 ) );
+
+    // the record is checked on the access
+    assert( throws( "record Pixel := w in let p := Pixel 1 in record Point := x y in p.x"
+                  , "expected a Point with the field x" ) );
+    assert( throws( shared + "record R := w in ( R 1 ).y", "expected a P or Q with the field y" ) );
+
+    for ( std::string bad : { "record P := x x in 1", "record P := x in ( P 1 ).y"
+                            , "record P := x in ( fun |- < P .y a > -> a ) 1", "record P := in 1" } )
+        assert( throws< parsing_error >( bad ) );
+}
+
+void test_types()
+{
+    using object_t = eval::object_t;
+
+    std::string expr = "type Expr := Num n | Add a b | Mul a b | Neg a | Var in "
+                       "let rec ev := fun |- x < Num n > -> n "
+                       "                  |- x < Add a b > -> ev x a + ev x b "
+                       "                  |- x < Mul a b > -> ev x a * ev x b "
+                       "                  |- x < Neg a > -> 0 - ev x a "
+                       "                  |- x < Var > -> x in ";
+    assert( run_source( expr + "ev 10 ( Add ( Num 1 ) ( Mul ( Var ) ( Neg ( Num 3 ) ) ) )" ) == object_t( -29 ) );
+    assert( run_source( expr + "ev 2 Var" ) == object_t( 2 ) );
+
+    // a declared constructor shadows the builtin one of the same name
+    assert( run_source( "type List := Nil | Cons h t in "
+                        "( fun |- < Cons h t > -> h |- < Nil > -> 0 ) ( Cons 5 Nil )" ) == object_t( 5 ) );
+    assert( run_source( "type Option := None | Some x in "
+                        "( fun |- < Some x > -> x |- < None > -> 0 ) ( map_lookup map_empty 1 )" ) == object_t( 0 ) );
+
+    // records are types with a single constructor
+    assert( run_source( "record P := x y in ( fun |- < P a b > -> a - b ) ( P 5 3 )" ) == object_t( 2 ) );
+
+    for ( std::string bad : { "type T := A | B x in ( fun |- < B > -> 1 ) A"
+                            , "type T := A | A in 1"
+                            , "type T := A x x in 1"
+                            , "record P := x y in ( fun |- < P a > -> a ) 1" } )
+        assert( throws< parsing_error >( bad ) );
+}
+
+void test_loops()
+{
+    using object_t = eval::object_t;
+
+    assert( run_source( "foldl ( fun a i -> a + i ) 0 ( range 0 100000 )" ) == object_t( int_t( 4999950000 ) ) );
+    assert( run_source( "foldl ( fun a i -> a + i ) 7 ( range 5 5 )" ) == object_t( 7 ) );
+    assert( run_source( "foldl ( fun a x -> a * 10 + x ) 0 ( array_range 1 4 )" ) == object_t( 123 ) );
+    assert( run_source( "foldl ( fun a x -> a + x ) 0.5 ( farray_make 3 1.0 )" ) == object_t( 3.5 ) );
+    assert( run_source( "foldl ( fun a x -> a + x ) 0 ( map ( fun x -> x * x ) ( range 0 4 ) )" ) == object_t( 14 ) );
+    assert( run_source( "iterate ( fun x -> x * 2 ) 1 20" ) == object_t( 1 << 20 ) );
+    assert( run_source( "iterate ( fun _ -> 3 ) 1 0" ) == object_t( 1 ) );
+
+    assert( run_source( "map ( fun x -> x * x ) ( array_range 0 4 )" )
+            == object_t( eval::types::int_array_t( { 0, 1, 4, 9 } ) ) );
+    assert( run_source( "map ( fun x -> x / 2.0 ) ( farray_make 2 1.0 )" )
+            == object_t( eval::types::float_array_t( { 0.5, 0.5 } ) ) );
+
+    // a function with several paths is called as usual
+    assert( run_source( "foldl ( fun |- a 2 -> a |- a i -> a + i ) 0 ( range 0 5 )" ) == object_t( 8 ) );
+
+    // closures capturing the arguments outlive their iteration
+    assert( run_source( "let fs := foldl ( fun a i -> Cons ( fun y -> i + y ) a ) Nil ( range 1 4 ) in "
+                        "( fun |- < Cons f < Cons g < Cons h t > > > -> f 0 * 100 + g 0 * 10 + h 0 ) fs" )
+            == object_t( 321 ) );
+
+    assert( throws( "map ( fun x -> true ) ( array_range 0 4 )" ) );
+}
+
+void test_parallel()
+{
+    using object_t = eval::object_t;
+
+    std::string fib = "let rec fib := fun |- 0 -> 0 |- 1 -> 1 |- n -> fib ( n - 1 ) + fib ( n - 2 ) in ";
+    for ( int threads : { 1, 2, 4 } )
+        assert( run_source( fib + "fib 18", threads ) == object_t( 2584 ) );
+
+    // arguments, which evaluate to closures over their own locals
+    std::string adder = "let rec adder := fun n -> let k := n * 2 in fun x -> x + k in ";
+    assert( run_source( adder + "( fun f g -> f 1 + g 2 ) ( adder 1 ) ( adder 10 )", 4 ) == object_t( 25 ) );
+
+    // such an argument is evaluated once, its closures are moved to the caller
+    std::string once = "let c := channel \"Int\" 8 in "
+                       "let rec mark := fun n -> let s := send c n in let k := n * 2 in fun x -> x + k in "
+                       "let total := ( fun f g -> f 1 + g 2 ) ( mark 1 ) ( mark 10 ) in "
+                       "let a := recv c in let b := recv c in "
+                       "( fun |- < Some x > -> 0 |- _ -> total ) ( try_recv c ) ";
+    for ( int threads : { 1, 4 } )
+        assert( run_source( once, threads ) == object_t( 25 ) );
+
+    // lists built in parallel, the errors of tasks are raised at the join
+    std::string build = "let rec build := fun |- 0 -> Nil |- n -> Cons n ( build ( n - 1 ) ) in "
+                        "let rec len := fun |- < Nil > -> 0 |- < Cons h t > -> 1 + len t in ";
+    assert( run_source( build + "len ( build 50 ) + len ( build 70 )", 4 ) == object_t( 120 ) );
+
+    assert( throws( build + "len ( build 50 ) + len ( build true )", "", 4 ) );
+
+    // the calls nested deep enough stay inline
+    auto tasks = [ & ]( std::size_t depth ) {
+        eval e;
+        e.enable_parallel( 2 );
+        e.fork_depth = depth;
+        e.state._store.scopes.add_scope();
+        builtins< eval >::add_builtins( e );
+        e.state._store.scopes.add_scope();
+        e.push( parse( fib + "fib 18" ) );
+        e.run();
+        assert( e.state._values.top() == object_t( 2584 ) );
+        long executed = 0;
+        for ( const auto& q : e.pool->queues )
+            executed += q->executed;
+        return executed;
+    };
+    assert( tasks( eval().fork_depth_limit ) == 0 );
+    // three cells a level, so calls are forked in the top four levels only
+    assert( tasks( eval().fork_depth_limit - 12 ) < 64 );
+}
+
+void test_parallel_map_reduce()
+{
+    using object_t = eval::object_t;
+
+    for ( int threads : { 0, 1, 3 } ) {
+        assert( run_source( "array_sum ( pmap ( fun x -> x * x ) ( range 0 1000 ) 64 )", threads )
+                == object_t( 332833500 ) );
+        assert( run_source( "array_get ( pmap ( fun x -> x + 1 ) ( array_range 0 10 ) 3 ) 9", threads )
+                == object_t( 10 ) );
+        assert( run_source( "preduce ( fun a b -> a + b ) 0 ( range 1 10001 ) 100", threads )
+                == object_t( 50005000 ) );
+        // a reduction without chunks is its identity
+        assert( run_source( "preduce ( fun a b -> a + b ) 7 ( range 0 0 ) 10", threads ) == object_t( 7 ) );
+    }
+
+    // the chunks are combined in their order, whatever the number of threads
+    std::string sum = "preduce ( fun a b -> a + b ) 0.0 ( pmap ( fun x -> x / 3.0 ) ( farray_make 5000 1.1 ) 7 ) 13";
+    object_t sequential = run_source( sum );
+    for ( int threads : { 1, 2, 4 } )
+        assert( run_source( sum, threads ) == sequential );
+    // not associative, so the grain decides the result
+    assert( run_source( "preduce ( fun a b -> a - b ) 0 ( array_range 0 4 ) 2" ) == object_t( 6 ) );
+
+    assert( run_source( "let rec len := fun |- < Nil > -> 0 |- < Cons h t > -> 1 + len t in "
+                        "len ( pool_stats 0 )", 2 ) == object_t( 3 ) );
+    assert( run_source( "pool_stats 0" ) == object_t( "Nil", eval::object_t::attrs_t{} ) );
+
+    assert( throws( "pmap ( fun x -> x ) ( array_range 0 10 ) 0", "", 2 ) );
+}
+
+void test_shared_program()
+{
+    using object_t = eval::object_t;
+
+    auto program = std::make_shared< eval::program_t >();
+    builtins< eval >::add_builtins( *program );
+    program->expressions.push_back( parse(
+        "let rec fib := fun |- 0 -> 0 |- 1 -> 1 |- n -> fib ( n - 1 ) + fib ( n - 2 ) in "
+        "let rec adder := fun n -> fun x -> x + n in "
+        "foldl ( fun acc x -> adder acc ( fib x ) ) 0 ( range 0 16 )" ) );
+    program->expressions.push_back( parse( "array_sum ( map ( fun x -> x * 2 ) ( array_range 0 100 ) )", 100 ) );
+
+    // independent evaluators of one program on several threads
+    std::vector< object_t > results( 8 );
+    std::vector< std::thread > threads;
+    for ( int i = 0; i < results.size(); i++ )
+        threads.emplace_back( [ &, i ]{
+            eval e( program );
+            results[ i ] = e.run_expression( i % 2 );
+        } );
+    for ( auto& t : threads )
+        t.join();
+    for ( int i = 0; i < results.size(); i++ )
+        assert( results[ i ] == object_t( i % 2 == 0 ? 1596 : 9900 ) );
+
+    // an evaluator runs the expressions one after the other
+    eval e( program );
+    assert( e.run_expression( 1 ) == object_t( 9900 ) );
+    assert( e.run_expression( 0 ) == object_t( 1596 ) );
+    assert( e.state._values.empty() );
+
+    // the globals are made once, the evaluators read the same objects
+    eval other( program );
+    auto id = e.state._store.lookup_id( "map" );
+    assert( &e.state._store.get( id ) == &other.state._store.get( id ) );
+}
+
+void test_futures()
+{
+    using object_t = eval::object_t;
+
+    std::string fib = "let rec fib := fun |- 0 -> 0 |- 1 -> 1 |- n -> fib ( n - 1 ) + fib ( n - 2 ) in ";
+    for ( int threads : { 0, 1, 3 } ) {
+        assert( run_source( fib + "let a := spawn ( fib 15 ) in let b := spawn ( fib 14 ) in "
+                                  "await a + await b", threads ) == object_t( 987 ) );
+        // futures are values, they may be awaited more than once
+        assert( run_source( fib + "let a := spawn ( fib 10 ) in await a * await a", threads ) == object_t( 3025 ) );
+        // nested spawns and a value referring to the closures of the task
+        assert( run_source( "await ( spawn ( await ( spawn ( 1 + 2 ) ) * 2 ) )", threads ) == object_t( 6 ) );
+        assert( run_source( "let k := 5 in ( await ( spawn ( let d := k * 2 in fun x -> x + d ) ) ) 1", threads )
+                == object_t( 11 ) );
+        // the spawned expression is evaluated once, though its value is a closure
+        assert( run_source( "let c := channel \"Int\" 4 in "
+                            "let f := spawn ( let s := send c 7 in let d := 3 in fun x -> x + d ) in "
+                            "let g := await f in let h := await f in "
+                            "let a := recv c in ( fun |- < Some x > -> 0 |- _ -> g a + h 1 ) ( try_recv c )", threads )
+                == object_t( 14 ) );
+    }
+
+    assert( run_source( "spawn ( 2 + 3 )" ).to_string() == "( Future ( Int 5 ) )" );
+
+    assert( throws( "let a := spawn ( 1 + true ) in await a", "", 2 ) );
+}
+
+void test_channels()
+{
+    using object_t = eval::object_t;
+
+    assert( run_source( "recv ( send ( send ( channel \"Int\" 2 ) 1 ) 2 )" ) == object_t( 1 ) );
+    assert( run_source( "try_recv ( channel \"\" 1 )" ) == object_t( "None", eval::object_t::attrs_t{} ) );
+
+    // a pipeline of two actors, the producer blocks while the channel is full
+    std::string pipeline =
+        "let numbers := channel \"Int\" 4 in "
+        "let squares := channel \"Int\" 4 in "
+        "let producer := actor ( fun n -> foldl ( fun c i -> send c i ) numbers ( range 0 n ) ) 100 in "
+        "let stage := actor ( fun n -> iterate ( fun c -> let x := recv numbers in send c ( x * x ) ) squares n ) 100 in "
+        "iterate ( fun acc -> acc + recv squares ) 0 100";
+    for ( int threads : { 0, 2 } )
+        assert( run_source( pipeline, threads ) == object_t( 328350 ) );
+
+    // tasks waiting for each other park instead of blocking the workers
+    std::string ping = "let c1 := channel \"Int\" 1 in let c2 := channel \"Int\" 1 in "
+                       "let p := spawn ( let x := recv c1 in send c2 ( x + 1 ) ) in "
+                       "let q := spawn ( let s := send c1 1 in recv c2 ) in "
+                       "let w := await p in await q";
+    for ( int threads : { 1, 2 } )
+        assert( run_source( ping, threads ) == object_t( 2 ) );
+
+    // the value of an actor is awaited like a future
+    assert( run_source( "await ( actor ( fun x -> x * 2 ) 21 )" ) == object_t( 42 ) );
+    assert( run_source( "( await ( actor ( fun x -> fun y -> x + y ) 1 ) ) 2" ) == object_t( 3 ) );
+
+    // an actor still waiting, when the evaluation is over, is stopped and joined
+    for ( int threads : { 0, 2 } ) {
+        object_t f = run_source( "let c := channel \"Int\" 1 in actor ( fun x -> recv c ) 0", threads );
+        const auto& actor = *f.get_value< eval::types::future_t >().result;
+        assert( actor.done && actor.error );
+    }
+
+    for ( std::string bad : { "send ( channel \"Int\" 1 ) true"
+                            , "send ( channel \"\" 1 ) ( fun x -> x )"
+                            , "channel \"Int\" 0" } )
+        assert( throws( bad ) );
+}
+
 int main()
 {
     test_run();
+    test_if_then_else();
+    test_short_circuit();
+    test_let_rec();
+    test_let_lazy();
+    test_streams();
+    test_arrays();
+    test_in_place();
+    test_maps();
+    test_big_ints();
+    test_floats();
+    test_strings();
+    test_records();
+    test_types();
+    test_loops();
+    test_parallel();
+    test_parallel_map_reduce();
+    test_shared_program();
+    test_futures();
+    test_channels();
 }
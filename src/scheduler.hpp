@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Round-robin scheduler of evaluations on a fixed number of threads. A job
+ *  runs for fuel cells, then it goes to the back of the queue, so short
+ *  jobs finish while long ones are still running. **/
+template < typename eval_t >
+struct scheduler
+{
+    using object_t = typename eval_t::object_t;
+
+    struct job_t
+    {
+        std::unique_ptr< eval_t > eval;
+        object_t value;
+        std::exception_ptr error;
+        std::atomic< bool > done{ false };
+        /** Number of slices the job ran for. **/
+        long slices = 0;
+        /** The position of the job among the finished ones. **/
+        long completion = -1;
+    };
+
+    using job_ptr = std::shared_ptr< job_t >;
+
+    const long fuel;
+
+    std::deque< job_ptr > queue;
+    std::vector< std::thread > workers;
+    long completed = 0;
+    bool stopping = false;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable finished;
+
+    scheduler( int threads, long fuel ) : fuel( fuel )
+    {
+        for ( int i = 0; i < threads; i++ )
+            workers.emplace_back( [ this ]{ work(); } );
+    }
+
+    scheduler( const scheduler& ) = delete;
+    scheduler& operator =( const scheduler& ) = delete;
+
+    /** The jobs still queued are dropped. **/
+    ~scheduler()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            stopping = true;
+        }
+        ready.notify_all();
+        for ( auto& w : workers )
+            w.join();
+    }
+
+    /** Schedules the cells pushed on the evaluator, its value is left in
+     *  the job. **/
+    job_ptr submit( std::unique_ptr< eval_t > e )
+    {
+        auto job = std::make_shared< job_t >();
+        job->eval = std::move( e );
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            queue.push_back( job );
+        }
+        ready.notify_one();
+        return job;
+    }
+
+    /** Waits for the job, rethrows its error. **/
+    const object_t& wait( const job_ptr& job )
+    {
+        std::unique_lock< std::mutex > lock( mutex );
+        finished.wait( lock, [ & ]{ return job->done.load(); } );
+        if ( job->error )
+            std::rethrow_exception( job->error );
+        return job->value;
+    }
+
+private:
+    void work()
+    {
+        while ( true ) {
+            job_ptr job;
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                ready.wait( lock, [ this ]{ return stopping || ! queue.empty(); } );
+                if ( stopping )
+                    return;
+                job = std::move( queue.front() );
+                queue.pop_front();
+            }
+
+            bool suspended = false;
+            try {
+                job->slices++;
+                suspended = job->eval->run_for( fuel ) == eval_t::run_status::suspended;
+                if ( ! suspended )
+                    job->value = job->eval->state.pop_value();
+            } catch ( ... ) {
+                job->error = std::current_exception();
+            }
+
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                if ( suspended ) {
+                    queue.push_back( std::move( job ) );
+                } else {
+                    job->completion = completed++;
+                    job->eval.reset();
+                    job->done = true;
+                }
+            }
+            if ( suspended )
+                ready.notify_one();
+            else
+                finished.notify_all();
+        }
+    }
+};
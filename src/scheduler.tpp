@@ -0,0 +1,98 @@
+#include <cassert>
+#include <memory>
+
+#include "parser.hpp"
+#include "eval.hpp"
+#include "builtins.hpp"
+#include "scheduler.hpp"
+
+using object_t = eval::object_t;
+
+std::shared_ptr< eval::program_t > make_program( std::vector< std::string > sources )
+{
+    auto program = std::make_shared< eval::program_t >();
+    builtins< eval >::add_builtins( *program );
+    for ( const auto& source : sources ) {
+        parser_str p( { source }, 10 );
+        p.fundef_count = 100 * program->expressions.size();
+        p.op_table.insert( { "+"s, { 6, false } } );
+        p.op_table.insert( { "-"s, { 6, false } } );
+        p.op_table.insert( { "*"s, { 7, false } } );
+        program->expressions.push_back( std::make_shared< ast::ast_node >( p.p_expression() ) );
+    }
+    return program;
+}
+
+std::unique_ptr< eval > evaluator( const std::shared_ptr< eval::program_t >& program, int i )
+{
+    auto e = std::make_unique< eval >( program );
+    e->push( ast::node_ref( program->expressions[ i ] ) );
+    return e;
+}
+
+std::string fib = "let rec fib := fun |- 0 -> 0 |- 1 -> 1 |- n -> fib ( n - 1 ) + fib ( n - 2 ) in ";
+
+void test_resume()
+{
+    auto program = make_program( { fib + "fib 15" } );
+
+    auto e = evaluator( program, 0 );
+    int slices = 1;
+    while ( e->run_for( 100 ) == eval::run_status::suspended )
+        slices++;
+    assert( slices > 10 );
+    assert( e->state.pop_value() == object_t( 610 ) );
+
+    e = evaluator( program, 0 );
+    auto now = std::chrono::steady_clock::now();
+    assert( e->run_until( now ) == eval::run_status::suspended );
+    assert( e->run_until( now + std::chrono::seconds( 60 ) ) == eval::run_status::finished );
+    assert( e->state.pop_value() == object_t( 610 ) );
+}
+
+void test_round_robin()
+{
+    auto program = make_program( { fib + "fib 18", "1 + 2 * 3", "fib 1" } );
+
+    scheduler< eval > s( 1, 200 );
+    auto long_job = s.submit( evaluator( program, 0 ) );
+    std::vector< scheduler< eval >::job_ptr > short_jobs;
+    for ( int i = 0; i < 50; i++ )
+        short_jobs.push_back( s.submit( evaluator( program, 1 ) ) );
+    auto failing = s.submit( evaluator( program, 2 ) );
+
+    assert( s.wait( long_job ) == object_t( 2584 ) );
+    assert( long_job->slices > 1 );
+    for ( const auto& job : short_jobs ) {
+        assert( s.wait( job ) == object_t( 7 ) );
+        assert( job->slices == 1 && job->completion < long_job->completion );
+    }
+
+    bool failed = false;
+    try {
+        s.wait( failing );
+    } catch ( std::runtime_error& e ) {
+        failed = true;
+    }
+    assert( failed );
+}
+
+void test_threads()
+{
+    auto program = make_program( { fib + "fib 10", "1 + 2 * 3" } );
+
+    scheduler< eval > s( 4, 200 );
+    std::vector< scheduler< eval >::job_ptr > jobs;
+    for ( int i = 0; i < 40; i++ )
+        jobs.push_back( s.submit( evaluator( program, i % 2 ) ) );
+    for ( int i = 0; i < jobs.size(); i++ )
+        assert( s.wait( jobs[ i ] ) == object_t( i % 2 == 0 ? 55 : 7 ) );
+    assert( s.completed == jobs.size() );
+}
+
+int main()
+{
+    test_resume();
+    test_round_robin();
+    test_threads();
+}
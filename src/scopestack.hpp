@@ -1,3 +1,5 @@
+#pragma once
+
 #include "k-either.hpp"
 #include "pprint.hpp"
 #include <map>
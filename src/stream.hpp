@@ -0,0 +1,77 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <variant>
+
+#include "types.hpp"
+
+template < typename object_t, typename fun_obj_t >
+struct stream_node;
+
+/** Lazy sequence, its elements are produced on demand by the evaluator (see
+ *  builtins::pull). Nodes are immutable and shared by derived streams, a
+ *  pipeline over a stream keeps only the current element alive. **/
+template < typename object_t, typename fun_obj_t >
+struct stream
+{
+    using node_t = stream_node< object_t, fun_obj_t >;
+
+    std::shared_ptr< const node_t > node;
+
+    template < typename kind_t >
+    static stream make( kind_t kind )
+    {
+        return { std::make_shared< const node_t >( node_t{ std::move( kind ) } ) };
+    }
+
+    bool operator ==( const stream &o ) const { return node == o.node; };
+
+    std::size_t hash() const { return std::hash< const node_t* >()( node.get() ); }
+
+    friend std::ostream& operator <<( std::ostream& os, const stream& s )
+    {
+        return os << "Stream";
+    }
+};
+
+template < typename object_t, typename fun_obj_t >
+struct stream_node
+{
+    using stream_t = stream< object_t, fun_obj_t >;
+
+    /** Integers in [ from, to ). **/
+    struct range
+    {
+        int_t from;
+        int_t to;
+    };
+
+    /** step seed is either < Nil > or < Cons x seed' >. **/
+    struct unfold
+    {
+        fun_obj_t step;
+        object_t seed;
+    };
+
+    struct map
+    {
+        fun_obj_t fun;
+        stream_t source;
+    };
+
+    struct filter
+    {
+        fun_obj_t predicate;
+        stream_t source;
+    };
+
+    struct take
+    {
+        int_t count;
+        stream_t source;
+    };
+
+    std::variant< range, unfold, map, filter, take > kind;
+};
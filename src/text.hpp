@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+/** Immutable string with O(1) length. Short strings are stored inline, a
+ *  longer one is a view of a shared buffer, so slicing does not copy, and a
+ *  long concatenation is a rope node referring to both parts. A rope deeper
+ *  than max_depth is rebuilt balanced from its leaves. **/
+struct text
+{
+    static constexpr std::size_t inline_capacity = 30;
+    /** Concatenations up to this length are copied into a flat buffer. **/
+    static constexpr std::size_t flat_limit = 256;
+    static constexpr int max_depth = 48;
+
+    struct small_t
+    {
+        std::array< char, inline_capacity > chars;
+    };
+
+    struct flat_t
+    {
+        std::shared_ptr< const std::string > buffer;
+        std::size_t offset;
+    };
+
+    struct concat_t
+    {
+        std::shared_ptr< const text > left;
+        std::shared_ptr< const text > right;
+        int depth;
+    };
+
+    std::variant< small_t, flat_t, concat_t > rep;
+    std::size_t length = 0;
+
+    text() : rep( small_t{} ) {}
+
+    text( std::string_view s ) : length( s.size() )
+    {
+        if ( s.size() <= inline_capacity ) {
+            small_t small{};
+            std::copy( s.begin(), s.end(), small.chars.begin() );
+            rep = small;
+        } else {
+            rep = flat_t{ std::make_shared< const std::string >( s ), 0 };
+        }
+    }
+
+    std::size_t size() const { return length; }
+
+    int depth() const
+    {
+        const concat_t* c = std::get_if< concat_t >( &rep );
+        return c ? c->depth : 0;
+    }
+
+    /** Calls f( std::string_view ) on the consecutive chunks of the text. **/
+    template < typename fun_t >
+    void for_each_chunk( fun_t&& f ) const
+    {
+        if ( const small_t* s = std::get_if< small_t >( &rep ) )
+            f( std::string_view( s->chars.data(), length ) );
+        else if ( const flat_t* flat = std::get_if< flat_t >( &rep ) )
+            f( std::string_view( flat->buffer->data() + flat->offset, length ) );
+        else {
+            const concat_t& c = std::get< concat_t >( rep );
+            c.left->for_each_chunk( f );
+            c.right->for_each_chunk( f );
+        }
+    }
+
+    std::string str() const
+    {
+        std::string result;
+        result.reserve( length );
+        for_each_chunk( [&]( std::string_view chunk ){ result.append( chunk ); } );
+        return result;
+    }
+
+    /** Requires i < size(). **/
+    char at( std::size_t i ) const
+    {
+        const text* t = this;
+        while ( const concat_t* c = std::get_if< concat_t >( &t->rep ) ) {
+            if ( i < c->left->length ) {
+                t = c->left.get();
+            } else {
+                i -= c->left->length;
+                t = c->right.get();
+            }
+        }
+        if ( const small_t* s = std::get_if< small_t >( &t->rep ) )
+            return s->chars[ i ];
+        const flat_t& flat = std::get< flat_t >( t->rep );
+        return ( *flat.buffer )[ flat.offset + i ];
+    }
+
+    /** Characters in [ from, to ), the bounds are checked by the caller. A
+     *  slice of a flat text shares its buffer. **/
+    text slice( std::size_t from, std::size_t to ) const
+    {
+        if ( from == 0 && to == length )
+            return *this;
+        if ( const small_t* s = std::get_if< small_t >( &rep ) )
+            return text( std::string_view( s->chars.data() + from, to - from ) );
+        if ( to - from <= inline_capacity )
+            return text( str_view_slice( from, to ) );
+        if ( const flat_t* flat = std::get_if< flat_t >( &rep ) ) {
+            text result;
+            result.rep = flat_t{ flat->buffer, flat->offset + from };
+            result.length = to - from;
+            return result;
+        }
+        const concat_t& c = std::get< concat_t >( rep );
+        std::size_t mid = c.left->length;
+        if ( to <= mid )
+            return c.left->slice( from, to );
+        if ( from >= mid )
+            return c.right->slice( from - mid, to - mid );
+        return concat( c.left->slice( from, mid ), c.right->slice( 0, to - mid ) );
+    }
+
+    static text concat( const text& a, const text& b )
+    {
+        if ( a.length == 0 )
+            return b;
+        if ( b.length == 0 )
+            return a;
+        if ( a.length + b.length <= flat_limit )
+            return text( a.str() + b.str() );
+
+        // a short piece appended to a rope extends its last leaf
+        if ( const concat_t* c = std::get_if< concat_t >( &a.rep ) )
+            if ( c->right->length + b.length <= flat_limit )
+                return node( *c->left, text( c->right->str() + b.str() ) );
+
+        text result = node( a, b );
+        if ( result.depth() <= max_depth )
+            return result;
+        std::vector< text > leaves;
+        result.collect_leaves( leaves );
+        return balanced( leaves, 0, leaves.size() );
+    }
+
+    /** Lexicographic comparison of the bytes, negative, zero or positive. **/
+    static int compare( const text& a, const text& b )
+    {
+        std::vector< std::string_view > xs = a.chunks(), ys = b.chunks();
+        std::size_t i = 0, j = 0, p = 0, q = 0;
+        while ( i < xs.size() && j < ys.size() ) {
+            std::size_t n = std::min( xs[ i ].size() - p, ys[ j ].size() - q );
+            int c = xs[ i ].substr( p, n ).compare( ys[ j ].substr( q, n ) );
+            if ( c != 0 )
+                return c;
+            p += n;
+            q += n;
+            if ( p == xs[ i ].size() ) { i++; p = 0; }
+            if ( q == ys[ j ].size() ) { j++; q = 0; }
+        }
+        return a.length < b.length ? -1 : a.length > b.length ? 1 : 0;
+    }
+
+    /** FNV-1a over the characters, independent of the representation. **/
+    std::size_t hash() const
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        for_each_chunk( [&]( std::string_view chunk ) {
+            for ( unsigned char c : chunk )
+                h = ( h ^ c ) * 1099511628211ull;
+        } );
+        return h;
+    }
+
+    bool operator ==( const text& o ) const
+    {
+        return length == o.length && compare( *this, o ) == 0;
+    }
+
+    friend std::ostream& operator <<( std::ostream& os, const text& t )
+    {
+        os << '"';
+        t.for_each_chunk( [&]( std::string_view chunk ){ os << chunk; } );
+        return os << '"';
+    }
+
+private:
+    static text node( const text& a, const text& b )
+    {
+        text result;
+        result.length = a.length + b.length;
+        result.rep = concat_t{ std::make_shared< const text >( a )
+                             , std::make_shared< const text >( b )
+                             , std::max( a.depth(), b.depth() ) + 1 };
+        return result;
+    }
+
+    void collect_leaves( std::vector< text >& leaves ) const
+    {
+        if ( const concat_t* c = std::get_if< concat_t >( &rep ) ) {
+            c->left->collect_leaves( leaves );
+            c->right->collect_leaves( leaves );
+        } else {
+            leaves.push_back( *this );
+        }
+    }
+
+    static text balanced( const std::vector< text >& leaves, std::size_t from, std::size_t to )
+    {
+        if ( to - from == 1 )
+            return leaves[ from ];
+        std::size_t mid = from + ( to - from ) / 2;
+        return node( balanced( leaves, from, mid ), balanced( leaves, mid, to ) );
+    }
+
+    std::vector< std::string_view > chunks() const
+    {
+        std::vector< std::string_view > result;
+        for_each_chunk( [&]( std::string_view chunk ) {
+            if ( ! chunk.empty() )
+                result.push_back( chunk );
+        } );
+        return result;
+    }
+
+    std::string str_view_slice( std::size_t from, std::size_t to ) const
+    {
+        std::string result;
+        for ( std::size_t i = from; i < to; i++ )
+            result.push_back( at( i ) );
+        return result;
+    }
+};
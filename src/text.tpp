@@ -0,0 +1,76 @@
+#include <cassert>
+#include <string>
+
+#include "text.hpp"
+
+void test_small()
+{
+    text a( "hello" );
+    assert( a.size() == 5 && a.str() == "hello" );
+    assert( std::holds_alternative< text::small_t >( a.rep ) );
+    assert( a.slice( 1, 4 ).str() == "ell" );
+    assert( text::concat( a, text( " world" ) ).str() == "hello world" );
+    assert( text().size() == 0 && text::concat( text(), a ) == a );
+}
+
+void test_flat_slices()
+{
+    std::string s( 1000, 'x' );
+    for ( size_t i = 0; i < s.size(); i++ )
+        s[ i ] = char( 'a' + i % 26 );
+    text t( s );
+
+    text middle = t.slice( 100, 900 );
+    assert( middle.str() == s.substr( 100, 800 ) );
+    // the slice shares the buffer
+    assert( std::get< text::flat_t >( middle.rep ).buffer == std::get< text::flat_t >( t.rep ).buffer );
+    assert( middle.slice( 10, 20 ).str() == s.substr( 110, 10 ) );
+    assert( middle.at( 0 ) == s[ 100 ] );
+}
+
+void test_ropes()
+{
+    std::string expected;
+    text t;
+    for ( int i = 0; i < 20000; i++ ) {
+        std::string piece = std::to_string( i ) + ",";
+        expected += piece;
+        t = text::concat( t, text( piece ) );
+    }
+    assert( t.size() == expected.size() );
+    assert( t.depth() <= text::max_depth );
+    assert( t.str() == expected );
+    for ( size_t i = 0; i < expected.size(); i += 997 )
+        assert( t.at( i ) == expected[ i ] );
+
+    text s = t.slice( 1234, 98765 );
+    assert( s.str() == expected.substr( 1234, 98765 - 1234 ) );
+
+    // appending large parts builds rope nodes
+    text big( std::string( 300, 'a' ) );
+    text rope = text::concat( big, text::concat( big, big ) );
+    assert( std::holds_alternative< text::concat_t >( rope.rep ) );
+    assert( rope.str() == std::string( 900, 'a' ) );
+}
+
+void test_compare_hash()
+{
+    std::string s( 500, 'q' );
+    text flat( s + "z" );
+    text rope = text::concat( text( s.substr( 0, 300 ) ), text( s.substr( 300 ) + "z" ) );
+
+    assert( flat == rope && flat.hash() == rope.hash() );
+    assert( text::compare( flat, rope ) == 0 );
+    assert( text::compare( text( "abc" ), text( "abd" ) ) < 0 );
+    assert( text::compare( text( "abc" ), text( "ab" ) ) > 0 );
+    assert( text::compare( rope, text::concat( text( s ), text( "a" ) ) ) > 0 );
+    assert( ! ( text( "a" ) == text( "b" ) ) );
+}
+
+int main()
+{
+    test_small();
+    test_flat_slices();
+    test_ropes();
+    test_compare_hash();
+}
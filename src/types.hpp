@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string> 
 
 using identifier_t = std::string;
+
+/** Representation of the Int values, which fit a machine word, larger ones
+ *  are stored as a bigint. **/
+using int_t = std::int64_t;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -44,6 +45,112 @@ struct function_path
     }
 };
 
+/** Match counts of the paths of one function definition, shared by all the
+ *  function objects created from it. Paths are tried in `order`, a path is
+ *  moved in front of its predecessor once it was matched more often and the
+ *  two paths are disjoint, so the first matching path never changes. **/
+struct dispatch_profile
+{
+    std::vector< int > order;
+    std::vector< long > hits;
+    std::vector< std::vector< bool > > disjoint;
+
+    dispatch_profile() = default;
+
+    dispatch_profile( std::vector< int > order, std::vector< long > hits )
+        : order( std::move( order ) )
+        , hits( std::move( hits ) ) {}
+
+    bool attached() const
+    {
+        return ! disjoint.empty();
+    }
+
+    template < typename function_path_t >
+    void attach( const std::vector< function_path_t >& paths )
+    {
+        int size = paths.size();
+        disjoint.assign( size, std::vector< bool >( size, false ) );
+        for ( int i = 0; i < size; i++ )
+            for ( int j = 0; j < size; j++ )
+                disjoint[ i ][ j ] = i != j && disjoint_paths( paths[ i ], paths[ j ] );
+
+        if ( ! valid_order() || hits.size() != size ) {
+            order.clear();
+            for ( int i = 0; i < size; i++ )
+                order.push_back( i );
+            hits.assign( size, 0 );
+        }
+    }
+
+    /** Records a match of the path on the given position in the order. **/
+    void hit( int position )
+    {
+        int index = order[ position ];
+        hits[ index ]++;
+        if ( position == 0 )
+            return;
+        int previous = order[ position - 1 ];
+        if ( hits[ index ] > hits[ previous ] && disjoint[ index ][ previous ] )
+            std::swap( order[ position - 1 ], order[ position ] );
+    }
+
+    template < typename function_path_t >
+    static bool disjoint_paths( const function_path_t& p, const function_path_t& q )
+    {
+        for ( int i = 0; i < p.input_patterns.size(); i++ )
+            if ( ! overlaps( p.input_patterns[ i ], q.input_patterns[ i ] ) )
+                return true;
+        return false;
+    }
+
+    /** An order is valid if it is a permutation of the paths, which swaps
+     *  only disjoint paths. The order may come from a stale profile. **/
+    bool valid_order() const
+    {
+        int size = disjoint.size();
+        if ( order.size() != size )
+            return false;
+        std::vector< bool > seen( size, false );
+        for ( int i : order ) {
+            if ( i < 0 || i >= size || seen[ i ] )
+                return false;
+            seen[ i ] = true;
+        }
+        for ( int i = 0; i < size; i++ )
+            for ( int j = i + 1; j < size; j++ )
+                if ( order[ i ] > order[ j ] && ! disjoint[ order[ i ] ][ order[ j ] ] )
+                    return false;
+        return true;
+    }
+
+    friend std::ostream& operator <<( std::ostream& os, const dispatch_profile& p )
+    {
+        os << p.order.size();
+        for ( int i : p.order )
+            os << " " << i;
+        for ( long h : p.hits )
+            os << " " << h;
+        return os;
+    }
+
+    friend std::istream& operator >>( std::istream& is, dispatch_profile& p )
+    {
+        int size = 0;
+        is >> size;
+        p.order.resize( size );
+        p.hits.resize( size );
+        for ( int& i : p.order )
+            is >> i;
+        for ( long& h : p.hits )
+            is >> h;
+        p.disjoint.clear();
+        return is;
+    }
+};
+
+using dispatch_profile_ptr = std::shared_ptr< dispatch_profile >;
+
 template< typename evaluable_t_ >
 struct function_object 
 {
@@ -52,13 +159,71 @@ struct function_object
 
     std::vector< function_path_t > paths;
     int arity_ = 0;
+    dispatch_profile_ptr profile;
+
+    /** Arguments on lazy positions are passed unevaluated, as thunks. **/
+    std::vector< bool > lazy_args;
 
-    function_object( std::vector< function_path_t > paths, int arity ) 
+    /** Jump table on the constructor tag of the argument in tag_column, the
+     *  paths which may match a tag first + i are by_tag[ i ], in order. **/
+    int tag_column = -1;
+    int tag_first = 0;
+    std::shared_ptr< const std::vector< std::vector< int > > > by_tag;
+
+    function_object( std::vector< function_path_t > paths
+                   , int arity
+                   , dispatch_profile_ptr profile = nullptr )
                    : paths( std::move( paths ) ) 
-                   , arity_( arity ) {};
+                   , arity_( arity )
+                   , profile( std::move( profile ) )
+    {
+        if ( this->profile && ! this->profile->attached() )
+            this->profile->attach( this->paths );
+        build_tag_table();
+    }
+
+    /** The table is built on the first column, whose patterns are all
+     *  variables or constructors of one declared type. **/
+    void build_tag_table()
+    {
+        for ( int column = 0; column < arity_; column++ ) {
+            std::optional< type_tag > type;
+            bool eligible = paths.size() > 1;
+            for ( const auto& path : paths ) {
+                const pattern& p = path.input_patterns[ column ];
+                if ( std::holds_alternative< variable_pattern >( p ) )
+                    continue;
+                const object_pattern* o = std::get_if< object_pattern >( &p );
+                if ( o == nullptr || ! o->tag.declared()
+                  || ( type && type->first != o->tag.first ) ) {
+                    eligible = false;
+                    break;
+                }
+                type = o->tag;
+            }
+            if ( ! eligible || ! type )
+                continue;
+
+            std::vector< std::vector< int > > table( type->count );
+            for ( int i = 0; i < paths.size(); i++ ) {
+                const pattern& p = paths[ i ].input_patterns[ column ];
+                if ( const object_pattern* o = std::get_if< object_pattern >( &p ) )
+                    table[ o->tag.tag - type->first ].push_back( i );
+                else
+                    for ( auto& candidates : table )
+                        candidates.push_back( i );
+            }
+            tag_column = column;
+            tag_first = type->first;
+            by_tag = std::make_shared< const std::vector< std::vector< int > > >( std::move( table ) );
+            return;
+        }
+    }
 
     bool operator ==( const function_object &o ) const { return true; };
 
+    std::size_t hash() const { return 0; }
+
     friend std::ostream& operator <<( std::ostream& os, const function_object& f )
     {
         os << "Function " << f.arity();
@@ -70,6 +235,20 @@ struct function_object
     int arity() const { return arity_; };
 };
 
+/** Hashes of the values, which may be stored in an object, consistent with
+ *  their operator ==. **/
+inline std::size_t hash_value( int_t v ) { return std::hash< int_t >()( v ); }
+inline std::size_t hash_value( bool v ) { return std::hash< bool >()( v ); }
+inline std::size_t hash_value( double v ) { return std::hash< double >()( v ); }
+
+template < typename T >
+auto hash_value( const T& v ) -> decltype( v.hash() ) { return v.hash(); }
+
+inline std::size_t hash_combine( std::size_t seed, std::size_t h )
+{
+    return seed ^ ( h + 0x9e3779b97f4a7c15 + ( seed << 6 ) + ( seed >> 2 ) );
+}
+
 template < typename types >
 struct object {
 
@@ -79,12 +258,15 @@ struct object {
 
     obj_name_t name; 
     std::variant< attrs_t, value_t > content;
+    // constructor tag, if the object was built by a declared constructor
+    int tag = -1;
 
     object() {}
 
-    object( obj_name_t name, attrs_t attrs ) 
+    object( obj_name_t name, attrs_t attrs, int tag = -1 ) 
         : name( std::move( name ) )
-        , content( std::move( attrs ) ) {}
+        , content( std::move( attrs ) )
+        , tag( tag ) {}
 
     object( obj_name_t name, value_t hidden_value ) 
         : name( std::move( name ) )
@@ -95,6 +277,9 @@ struct object {
         : name( types::template type_name< T >() )
         , content( value ) {};
 
+    /** C++ integer literals are stored as the Int representation. **/
+    object( int value ) : object( int_t( value ) ) {}
+
     bool operator==( object other ) const
     {
         return other.name == name && other.content == content;
@@ -133,6 +318,18 @@ struct object {
         return omega() ? 1 : get_attrs().size();
     }
 
+    /** Structural hash, equal objects have equal hashes. **/
+    std::size_t hash() const
+    {
+        std::size_t h = std::hash< obj_name_t >()( name );
+        if ( const value_t *value = std::get_if< value_t >( &content ) )
+            return hash_combine( h, std::visit( []( const auto& v ){ return hash_value( v ); }
+                                              , *value ) );
+        for ( const auto& a : get_attrs() )
+            h = hash_combine( h, a.hash() );
+        return h;
+    }
+
     std::string value_to_string( const value_t &value ) const {
         std::stringstream ss;
         pprint::PrettyPrinter printer( ss );
@@ -174,6 +371,9 @@ bool match( const pattern& p, const object< value_t >& o, matching_t< value_t >&
 template< typename value_t >
 bool match( const variable_pattern& p, const object< value_t >& o, matching_t< value_t >& match )
 {
+    // the wildcard matches anything without binding it
+    if ( p.variable_name == "_" )
+        return true;
     const auto &[ it, succ ] = match.insert( { p.variable_name, o } );
     if ( !succ )
         throw std::runtime_error( "multiple variables with same name not implemented" );
@@ -183,7 +383,8 @@ bool match( const variable_pattern& p, const object< value_t >& o, matching_t< v
 template< typename value_t >
 bool match( const object_pattern& p, const object< value_t >& o, matching_t< value_t >& m ) 
 {
-    if ( o.name != p.name ) {
+    // constructors of declared types are compared by their tags
+    if ( p.tag.declared() && o.tag >= 0 ? o.tag != p.tag.tag : o.name != p.name ) {
         return false;
     }
 
@@ -233,10 +434,8 @@ bool match( const literal_pattern< T >& p, const object< value_t >& o, matching_
     if ( o.name != p.name ) {
         return false;
     }
-    if ( o.template has_value< T >() && o.template get_value< T >() != p.value ) {
-        return false;
-    }
-    return true;
+    // an Int literal does not match a big Int, which has the same name
+    return o.template has_value< T >() && o.template get_value< T >() == p.value;
 }
 
 template < typename value_t, typename evaluable_t >
@@ -259,10 +458,13 @@ either< std::string, matching_t< value_t > > match
     return std::move( matching ); 
 }
 
+/** The paths are tried in the order of the profile, which is updated by
+ *  the match, only if adaptive is set. **/
 template < typename value_t, typename evaluable_t >
 either< std::string, std::pair< matching_t< value_t >, evaluable_t > > match
     ( const function_object< evaluable_t >& funobj
-    , const std::vector< object< value_t > >& objects )
+    , const std::vector< object< value_t > >& objects
+    , bool adaptive = true )
 {
     if ( objects.size() != funobj.arity() ) 
         return "expected "s 
@@ -272,6 +474,35 @@ either< std::string, std::pair< matching_t< value_t >, evaluable_t > > match
     
     std::string message;
 
+    if ( funobj.by_tag ) {
+        int t = objects[ funobj.tag_column ].tag - funobj.tag_first;
+        if ( t >= 0 && t < funobj.by_tag->size() ) {
+            for ( int i : ( *funobj.by_tag )[ t ] ) {
+                const auto& f_path = funobj.paths[ i ];
+                auto res = match( f_path, objects );
+                if ( res.isright() )
+                    return std::pair{ res.right(), f_path.evaluable };
+                message.append( std::move( res.left() ) );
+            }
+            return message.empty() ? "no path for "s + objects[ funobj.tag_column ].name
+                                   : message;
+        }
+    }
+
+    if ( adaptive && funobj.profile ) {
+        const auto& order = funobj.profile->order;
+        for ( int i = 0; i < order.size(); i++ ) {
+            const auto& f_path = funobj.paths[ order[ i ] ];
+            auto res = match( f_path, objects );
+            if ( res.isright() ) {
+                funobj.profile->hit( i );
+                return std::pair{ res.right(), f_path.evaluable };
+            }
+            message.append( std::move( res.left() ) );
+        }
+        return message;
+    }
+
     for ( const auto& f_path : funobj.paths ) {
 
         auto res = match( f_path, objects );
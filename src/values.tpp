@@ -133,16 +133,121 @@ void test_pattern ()
     );
 }
 
+template< typename value_t >
+void test_dispatch_profile()
+{
+    using object = object< value_t >;
+
+    object int_0( 0 );
+    object int_1( 1 );
+    object int_7( 7 );
+
+    literal_pattern p_int_0( "Int", 0 );
+    literal_pattern p_int_1( "Int", 1 );
+    variable_pattern p_n( "n" );
+
+    auto profile = std::make_shared< dispatch_profile >();
+    function_object< int > funobj( {
+        function_path< int >( { p_int_0 }, variable_pattern( "r" ), 0 ),
+        function_path< int >( { p_int_1 }, variable_pattern( "r" ), 1 ),
+        function_path< int >( { p_n },     variable_pattern( "r" ), 2 )
+    }, 1, profile );
+
+    assert( ( profile->order == std::vector< int >{ 0, 1, 2 } ) );
+
+    for ( int i = 0; i < 3; i++ )
+        assert( match( funobj, std::vector< object >{ int_1 } ).right().second == 1 );
+
+    // the literals are disjoint, the variable path overlaps both of them
+    assert( ( profile->order == std::vector< int >{ 1, 0, 2 } ) );
+
+    for ( int i = 0; i < 10; i++ )
+        assert( match( funobj, std::vector< object >{ int_7 } ).right().second == 2 );
+    assert( ( profile->order == std::vector< int >{ 1, 0, 2 } ) );
+    assert( match( funobj, std::vector< object >{ int_0 } ).right().second == 0 );
+
+    // without adaptive dispatch the paths are tried in order, the profile is left alone
+    std::vector< long > hits = profile->hits;
+    for ( int i = 0; i < 5; i++ )
+        assert( match( funobj, std::vector< object >{ int_0 }, false ).right().second == 0 );
+    assert( profile->hits == hits && ( profile->order == std::vector< int >{ 1, 0, 2 } ) );
+
+    // a stale order, which breaks first-match semantics, is reset
+    std::stringstream ss( "3 2 0 1 5 5 5" );
+    auto loaded = std::make_shared< dispatch_profile >();
+    ss >> *loaded;
+    function_object< int > reloaded( funobj.paths, 1, loaded );
+    assert( ( loaded->order == std::vector< int >{ 0, 1, 2 } ) );
+
+    std::stringstream saved;
+    saved << *profile;
+    auto restored = std::make_shared< dispatch_profile >();
+    saved >> *restored;
+    function_object< int > restored_obj( funobj.paths, 1, restored );
+    assert( restored->order == profile->order );
+    assert( restored->hits == profile->hits );
+}
+
+template< typename value_t >
+void test_tag_dispatch()
+{
+    using object = object< value_t >;
+    using attrs_t = typename object::attrs_t;
+
+    // type Expr := Num n | Add a b | Neg a, with the tags 4, 5, 6
+    type_tag num{ 4, 4, 3 }, add{ 5, 4, 3 }, neg{ 6, 4, 3 };
+    object_pattern p_num( "Num", { variable_pattern( "n" ) }, num );
+    object_pattern p_add( "Add", { variable_pattern( "a" ), variable_pattern( "b" ) }, add );
+    object_pattern p_neg( "Neg", { variable_pattern( "a" ) }, neg );
+
+    function_object< int > funobj( {
+        function_path< int >( { variable_pattern( "env" ), p_num }, variable_pattern( "r" ), 0 ),
+        function_path< int >( { variable_pattern( "env" ), p_add }, variable_pattern( "r" ), 1 ),
+        function_path< int >( { literal_pattern( "Int", 0 ), variable_pattern( "e" ) }, variable_pattern( "r" ), 2 ),
+        function_path< int >( { variable_pattern( "env" ), p_neg }, variable_pattern( "r" ), 3 )
+    }, 2 );
+
+    // the first column has a literal, the second one is dispatched on
+    assert( funobj.tag_column == 1 && funobj.tag_first == 4 );
+    assert( ( ( *funobj.by_tag )[ 0 ] == std::vector< int >{ 0, 2 } ) );
+    assert( ( ( *funobj.by_tag )[ 2 ] == std::vector< int >{ 2, 3 } ) );
+
+    object n( "Num", attrs_t{ object( 1 ) }, 4 );
+    object sum( "Add", attrs_t{ n, n }, 5 );
+    object negated( "Neg", attrs_t{ n }, 6 );
+    assert( match( funobj, std::vector< object >{ object( 0 ), n } ).right().second == 0 );
+    assert( match( funobj, std::vector< object >{ object( 0 ), sum } ).right().second == 1 );
+    assert( match( funobj, std::vector< object >{ object( 1 ), negated } ).right().second == 3 );
+
+    // untagged objects are matched by name, tagged ones by the tag
+    object untagged( "Neg", attrs_t{ n } );
+    assert( match( funobj, std::vector< object >{ object( 0 ), untagged } ).right().second == 2 );
+    assert( match( funobj, std::vector< object >{ object( 1 ), untagged } ).right().second == 3 );
+    object other( "Neg", attrs_t{ n }, 9 );
+    assert( match( funobj, std::vector< object >{ object( 1 ), other } ).isleft() );
+
+    // patterns of two types, no table
+    object_pattern p_other( "Leaf", {}, type_tag{ 0, 0, 1 } );
+    function_object< int > mixed( {
+        function_path< int >( { p_num }, variable_pattern( "r" ), 0 ),
+        function_path< int >( { p_other }, variable_pattern( "r" ), 1 )
+    }, 1 );
+    assert( ! mixed.by_tag && mixed.tag_column == -1 );
+}
+
 struct test_types_
 {
     using fun_obj_t = function_object< int >;
-    using value_t = std::variant< int
+    using value_t = std::variant< int_t
+                                , double
                                 , bool
                                 , fun_obj_t >;
     template< typename T > 
     static constexpr const char * type_name() {
-        if constexpr ( std::is_same< T, int >::value ) 
+        if constexpr ( std::is_same< T, int_t >::value ) 
             return "Int";
+        else if constexpr ( std::is_same< T, double >::value )
+            return "Float";
         else if constexpr ( std::is_same< T, bool >::value ) 
             return "Bool";
         else if constexpr ( std::is_same< T, fun_obj_t >::value )
@@ -155,6 +260,8 @@ struct test_types_
 void test_patterns()
 {
     test_pattern< test_types_ >();
+    test_dispatch_profile< test_types_ >();
+    test_tag_dispatch< test_types_ >();
 }
 
 int main()